@@ -42,25 +42,121 @@
 #include "common.h"
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Barrier between touching an element and publishing a position
+ *
+ * On the Cortex-M4 the producer and consumer are an ISR and thread mode on the
+ * same core, so only the compiler may reorder the accesses. Host builds (tests)
+ * run the two sides on separate threads and need a real fence.
+ */
+#if defined(__arm__)
+#define FIFO_Barrier() __asm volatile ("" ::: "memory")
+#else
+#define FIFO_Barrier() __atomic_thread_fence(__ATOMIC_ACQ_REL)
+#endif
+
+/**
+ * @brief What FIFO_Write/FIFO_WriteN do when the FIFO is full
+ */
+typedef enum {
+  FIFO_OVERFLOW_DROP_NEWEST = 0,  /**< Reject the incoming element, count it and signal (default) */
+  FIFO_OVERFLOW_OVERWRITE_OLDEST, /**< Discard the oldest element to make room, count it */
+  FIFO_OVERFLOW_BLOCK             /**< Signal once then wait for the consumer to make room @note never from an ISR */
+} FIFOOverflowPolicy_t;
+
+/**
+ * @brief Number of occupancy histogram buckets, bucket i counts writes that
+ * left the FIFO between i/FIFO_STATS_BUCKETS and (i+1)/FIFO_STATS_BUCKETS full
+ */
+#define FIFO_STATS_BUCKETS 8
+
+/**
+ * @brief FIFO instrumentation, only kept when EN_FIFO_STATS is defined
+ *
+ * The producer only touches the write side fields and the consumer only the
+ * read side fields, so keeping them does not add any sharing between the two.
+ * Peak and the histogram are sampled after each write call, so they show the
+ * occupancy the producer saw and never under report.
+ */
+typedef struct {
+  uint32_t Peak;                          /**< Highest occupancy seen */
+  uint32_t Writes;                        /**< Elements written */
+  uint32_t Reads;                         /**< Elements read */
+  uint32_t Overflows;                     /**< Writes that found the FIFO full */
+  uint32_t Underflows;                    /**< Reads that got fewer elements than they asked for */
+  uint32_t Histogram[FIFO_STATS_BUCKETS]; /**< Occupancy after each write, see FIFO_STATS_BUCKETS */
+} FIFOStats_TypeDef;
+
+#ifdef EN_FIFO_STATS
+/**
+ * @brief Record a write call that left occupancy elements in a maxSize FIFO
+ */
+static inline void FIFO_StatsSample(FIFOStats_TypeDef *stats, uint32_t occupancy, uint32_t maxSize) {
+  if (occupancy > stats->Peak) {
+    stats->Peak = occupancy;
+  }
+
+  if (occupancy) {
+    stats->Histogram[((occupancy - 1) * FIFO_STATS_BUCKETS) / maxSize]++;
+  }
+}
+#endif
+
 /**
  * @brief FIFO Context
  *
  * This context is initialized by the FIFO_Iinit api and serves as
  * the context to each API call. This enables multiple FIFO contexts to
  * be used by this one API.
+ *
+ * The context is lock free for a single producer and a single consumer:
+ * the producer only ever stores WritePos and the consumer only ever stores
+ * ReadPos. Both positions run over [0, 2 * MaxSize) so a full buffer can be
+ * told apart from an empty one without a shared size counter, which means
+ * an ISR can write while the main loop reads without masking the interrupt.
+ *
+ * The one exception is FIFO_OVERFLOW_OVERWRITE_OLDEST where the producer
+ * pushes ReadPos forward itself. Both sides then move ReadPos with a compare
+ * and swap (LDREX/STREX on the Cortex-M4) and the consumer retries a read the
+ * producer overtook. Positions repeat every 2 * MaxSize writes, so an
+ * overwrite ring must be big enough that the producer can't lap it twice
+ * during a single read.
  */
-typedef struct {
-  uint32_t MaxSize;     /**< Maximum size of buffer @note it's on the caller to actually allocate buffer*/
-  uint32_t CurrentSize; /**< Current size in use */
-  uint32_t WritePos;    /**< Current write position in the buffer */
-  uint32_t ReadPos;     /**< Current read position in the buffer */
-  uint32_t BufferWidth; /**< The datat type size of the buffer */
-  void *Buffer;         /**< void pointer to the data buffer to use for this context */
-} FIFOContext_TypeDef;
-
-int FIFO_Init(FIFOContext_TypeDef *ctx, uint32_t maxSize, uint32_t bufferWidth, void *buffer);
-int FIFO_Write(FIFOContext_TypeDef *ctx, void(* setFun)(void*, void*), void *val);
-int FIFO_Read(FIFOContext_TypeDef *ctx, void(* retFun)(void*, void*), void *ret);
+typedef struct FIFOContext_TypeDef FIFOContext_TypeDef;
+
+struct FIFOContext_TypeDef {
+  uint32_t MaxSize;           /**< Maximum size of buffer @note it's on the caller to actually allocate buffer*/
+  volatile uint32_t WritePos; /**< Current write position, only modified by the producer */
+  volatile uint32_t ReadPos;  /**< Current read position, only stored by the consumer, except under FIFO_OVERFLOW_OVERWRITE_OLDEST where both sides move it with a compare and swap */
+  uint32_t BufferWidth;       /**< The datat type size of the buffer */
+  void *Buffer;               /**< void pointer to the data buffer to use for this context */
+  FIFOOverflowPolicy_t OverflowPolicy;           /**< What to do with a write to a full FIFO */
+  void (*OnOverflow)(FIFOContext_TypeDef *ctx);  /**< Optional signal raised from the producer on overflow */
+  volatile uint32_t Dropped;  /**< Elements lost to overflow, only modified by the producer */
+#ifdef EN_FIFO_STATS
+  FIFOStats_TypeDef Stats;    /**< Instrumentation, read it with FIFO_GetStats */
+#endif
+};
+
+int_fast8_t FIFO_Init(FIFOContext_TypeDef *ctx, uint32_t maxSize, uint32_t bufferWidth, void *buffer);
+void        FIFO_SetOverflowPolicy(FIFOContext_TypeDef *ctx, FIFOOverflowPolicy_t policy, void (*onOverflow)(FIFOContext_TypeDef *ctx));
+int_fast8_t FIFO_Write(FIFOContext_TypeDef *ctx, void(* setFun)(void*, void*), void *val);
+int_fast8_t FIFO_WriteByte(FIFOContext_TypeDef *ctx, uint8_t value);
+int_fast8_t FIFO_Read(FIFOContext_TypeDef *ctx, void(* retFun)(void*, void*), void *ret);
+uint32_t    FIFO_WriteN(FIFOContext_TypeDef *ctx, const void *source, uint32_t count);
+uint32_t    FIFO_ReadN(FIFOContext_TypeDef *ctx, void *destination, uint32_t count);
+uint32_t    FIFO_ReserveWrite(FIFOContext_TypeDef *ctx, void **region);
+int_fast8_t FIFO_CommitWrite(FIFOContext_TypeDef *ctx, uint32_t count);
+uint32_t    FIFO_PeekContiguous(FIFOContext_TypeDef *ctx, const void **region);
+int_fast8_t FIFO_Consume(FIFOContext_TypeDef *ctx, uint32_t count);
+uint32_t    FIFO_Count(const FIFOContext_TypeDef *ctx);
+uint32_t    FIFO_Space(const FIFOContext_TypeDef *ctx);
+uint32_t    FIFO_Dropped(const FIFOContext_TypeDef *ctx);
+int_fast8_t FIFO_GetStats(const FIFOContext_TypeDef *ctx, FIFOStats_TypeDef *stats);
 
 /**********************************************************************
 *      Macros for generating type spefic FIFO get/set functions      *
@@ -279,4 +375,8 @@ CREATE_FIFO_SETTER_PROTO(uintmax_t);
 #define FIFO_Read_uintmax_t(ctx, ret) FIFO_Read(&(ctx), FIFO_Get_uintmax_t, &(ret))
 #endif
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* ifndef FIFO_H */
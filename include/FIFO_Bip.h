@@ -0,0 +1,76 @@
+/**
+ * @file FIFO_Bip.h
+ * @author Matthew Philyaw (matthew.philyaw@gmail.com)
+ *
+ * @brief Bip buffer, a ring that only hands out contiguous regions
+ *
+ * A plain ring returns data in up to two fragments once it wraps. The bip
+ * buffer never does: when a reservation doesn't fit in the tail the producer
+ * starts over at index 0 and records a watermark where the data in the tail
+ * ends, the consumer reads up to the watermark and then follows it to 0.
+ * Every reservation and every read is one pointer and one length, which is
+ * what a single DMA transfer or an in place parser wants.
+ *
+ * The price is the tail left unused when a reservation wraps. Lock free for a
+ * single producer and a single consumer.
+ *
+ * @code
+ * static uint8_t txBuffer[128];
+ * static FIFOBipContext_TypeDef tx;
+ *
+ * FIFO_Bip_Init(&tx, sizeof(txBuffer), txBuffer);
+ *
+ * // producer
+ * uint8_t *region;
+ * if (!FIFO_Bip_Reserve(&tx, 16, (void **)&region)) {
+ *   uint32_t length = Format(region, 16);
+ *   FIFO_Bip_Commit(&tx, length);
+ * }
+ *
+ * // consumer, one DMA transfer per region
+ * const void *data;
+ * uint32_t length = FIFO_Bip_Peek(&tx, &data);
+ * StartTransfer(data, length);
+ * ...
+ * FIFO_Bip_Consume(&tx, length);
+ * @endcode
+ */
+#ifndef __FIFO_BIP_H__
+#define __FIFO_BIP_H__
+
+#include "FIFO.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Bip FIFO Context
+ *
+ * WritePos, ReadPos and Watermark are buffer indexes in [0, MaxSize]. When
+ * WritePos < ReadPos the producer has wrapped and the consumer's data ends
+ * at Watermark instead of WritePos.
+ */
+typedef struct {
+  uint32_t MaxSize;            /**< Size of Buffer in bytes */
+  volatile uint32_t WritePos;  /**< End of the committed data, only modified by the producer */
+  volatile uint32_t ReadPos;   /**< Start of the unread data, only modified by the consumer */
+  volatile uint32_t Watermark; /**< End of the data in the tail once wrapped, only modified by the producer */
+  uint32_t ReserveIndex;       /**< Start of the pending reservation, only used by the producer */
+  uint32_t Reserved;           /**< Length of the pending reservation, only used by the producer */
+  uint8_t *Buffer;             /**< Byte storage @note it's on the caller to allocate it */
+} FIFOBipContext_TypeDef;
+
+int_fast8_t FIFO_Bip_Init(FIFOBipContext_TypeDef *ctx, uint32_t maxSize, void *buffer);
+int_fast8_t FIFO_Bip_Reserve(FIFOBipContext_TypeDef *ctx, uint32_t count, void **region);
+uint32_t    FIFO_Bip_ReserveMax(FIFOBipContext_TypeDef *ctx, void **region);
+int_fast8_t FIFO_Bip_Commit(FIFOBipContext_TypeDef *ctx, uint32_t count);
+int_fast8_t FIFO_Bip_Write(FIFOBipContext_TypeDef *ctx, const void *source, uint32_t count);
+uint32_t    FIFO_Bip_Peek(FIFOBipContext_TypeDef *ctx, const void **region);
+int_fast8_t FIFO_Bip_Consume(FIFOBipContext_TypeDef *ctx, uint32_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef FIFO_BIP_H */
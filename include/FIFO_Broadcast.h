@@ -0,0 +1,82 @@
+/**
+ * @file FIFO_Broadcast.h
+ * @author Matthew Philyaw (matthew.philyaw@gmail.com)
+ *
+ * @brief Single writer, multi reader broadcast byte ring
+ *
+ * One producer writes a byte stream that any number of readers consume
+ * independently, each with its own cursor, so the echo path, a protocol
+ * parser and a logger can all see the same received bytes without copying
+ * them into separate FIFOs.
+ *
+ * The producer never waits for anyone and never fails, it just overwrites
+ * the oldest bytes. A reader that falls more than MaxSize bytes behind loses
+ * the overwritten bytes: its cursor is moved up to the oldest byte still in
+ * the ring, the loss is added to Lost and the Overrun flag is raised. Reads
+ * are checked against the producer after copying, so a byte overwritten
+ * while it was being read is never returned.
+ *
+ * @code
+ * static uint8_t rxBuffer[64];
+ * static FIFOBroadcastContext_TypeDef rx;
+ * static FIFOBroadcastReader_TypeDef echo, logger;
+ *
+ * FIFO_Broadcast_Init(&rx, sizeof(rxBuffer), rxBuffer);
+ * FIFO_Broadcast_ReaderInit(&echo, &rx);
+ * FIFO_Broadcast_ReaderInit(&logger, &rx);
+ *
+ * // the USART interrupts write every received byte
+ * SerialPort3.SetRxBroadcast(&rx);
+ *
+ * // each reader on its own
+ * uint32_t n = FIFO_Broadcast_ReadN(&logger, out, sizeof(out));
+ * if (FIFO_Broadcast_CheckOverrun(&logger)) {
+ *   // logger fell behind, mark the gap
+ * }
+ * @endcode
+ */
+#ifndef __FIFO_BROADCAST_H__
+#define __FIFO_BROADCAST_H__
+
+#include "FIFO.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Broadcast FIFO Context
+ *
+ * Positions are free running and MaxSize must be a power of two. The
+ * producer moves WriteClaim before it touches the buffer and WritePos after,
+ * bytes before WriteClaim - MaxSize may already be overwritten.
+ */
+typedef struct {
+  uint32_t MaxSize;             /**< Size of Buffer, must be a power of two */
+  volatile uint32_t WritePos;   /**< End of the published bytes, only modified by the producer */
+  volatile uint32_t WriteClaim; /**< End of the bytes being written, only modified by the producer */
+  uint8_t *Buffer;              /**< Byte storage @note it's on the caller to allocate it */
+} FIFOBroadcastContext_TypeDef;
+
+/**
+ * @brief Broadcast reader cursor, owned by one consumer
+ */
+typedef struct {
+  FIFOBroadcastContext_TypeDef *Fifo; /**< Ring this reader follows */
+  uint32_t ReadPos;                   /**< Next position to read */
+  uint32_t Lost;                      /**< Bytes overwritten before this reader got to them */
+  uint_fast8_t Overrun;               /**< Set when bytes are lost, cleared by FIFO_Broadcast_CheckOverrun */
+} FIFOBroadcastReader_TypeDef;
+
+int_fast8_t  FIFO_Broadcast_Init(FIFOBroadcastContext_TypeDef *ctx, uint32_t maxSize, uint8_t *buffer);
+void         FIFO_Broadcast_Write(FIFOBroadcastContext_TypeDef *ctx, const uint8_t *source, uint32_t count);
+void         FIFO_Broadcast_ReaderInit(FIFOBroadcastReader_TypeDef *reader, FIFOBroadcastContext_TypeDef *ctx);
+uint32_t     FIFO_Broadcast_ReadN(FIFOBroadcastReader_TypeDef *reader, uint8_t *destination, uint32_t count);
+uint32_t     FIFO_Broadcast_Lag(const FIFOBroadcastReader_TypeDef *reader);
+uint_fast8_t FIFO_Broadcast_CheckOverrun(FIFOBroadcastReader_TypeDef *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef FIFO_BROADCAST_H */
@@ -0,0 +1,75 @@
+/**
+ * @file FIFO_MPSC.h
+ * @author Matthew Philyaw (matthew.philyaw@gmail.com)
+ *
+ * @brief Multi producer/single consumer byte FIFO
+ *
+ * Any number of producers (ISRs at any priority and the main loop) can write
+ * into one ring without masking interrupts. A producer claims its span by
+ * moving Head with a compare and swap, copies its bytes in and then flags
+ * each slot ready. The single consumer only ever reads slots that are flagged,
+ * so a producer that is interrupted half way through a write just holds the
+ * bytes behind it back until it finishes. The bytes of one write are never
+ * interleaved with another producer's.
+ *
+ * The compare and swap is LDREX/STREX on the Cortex-M4 and C11 atomics on the
+ * host, see FIFO_MPSC.c.
+ *
+ * @code
+ * static uint8_t txBuffer[64];
+ * static uint8_t txReady[64];
+ * static FIFOMPSCContext_TypeDef tx;
+ *
+ * FIFO_MPSC_Init(&tx, 64, txBuffer, txReady);
+ *
+ * // from SysTick_Handler, USART3_IRQHandler or main()
+ * FIFO_MPSC_Write(&tx, (const uint8_t *)"ok\r", 3);
+ *
+ * // single consumer
+ * uint8_t out[16];
+ * uint32_t n = FIFO_MPSC_ReadN(&tx, out, sizeof(out));
+ * @endcode
+ */
+#ifndef __FIFO_MPSC_H__
+#define __FIFO_MPSC_H__
+
+#include "FIFO.h"
+
+#if defined(__arm__)
+typedef volatile uint32_t FIFOAtomic_t;
+#else
+#include <stdatomic.h>
+typedef _Atomic uint32_t FIFOAtomic_t;
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief MPSC FIFO Context
+ *
+ * Positions are free running and MaxSize must be a power of two.
+ */
+typedef struct {
+  uint32_t MaxSize;         /**< Size of Buffer and Ready, must be a power of two */
+  FIFOAtomic_t Head;        /**< Next position to claim, moved by producers with compare and swap */
+  volatile uint32_t Tail;   /**< Next position to read, only modified by the consumer */
+  FIFOAtomic_t Dropped;     /**< Bytes rejected because the ring was full */
+  uint8_t *Buffer;          /**< Byte storage @note it's on the caller to allocate it */
+  volatile uint8_t *Ready;  /**< One flag per slot, set by the producer once the byte is in */
+} FIFOMPSCContext_TypeDef;
+
+int_fast8_t FIFO_MPSC_Init(FIFOMPSCContext_TypeDef *ctx, uint32_t maxSize, uint8_t *buffer, uint8_t *ready);
+int_fast8_t FIFO_MPSC_Write(FIFOMPSCContext_TypeDef *ctx, const uint8_t *source, uint32_t length);
+uint32_t    FIFO_MPSC_ReadN(FIFOMPSCContext_TypeDef *ctx, uint8_t *destination, uint32_t count);
+uint32_t    FIFO_MPSC_PeekContiguous(FIFOMPSCContext_TypeDef *ctx, const uint8_t **region);
+int_fast8_t FIFO_MPSC_Consume(FIFOMPSCContext_TypeDef *ctx, uint32_t count);
+uint32_t    FIFO_MPSC_Count(FIFOMPSCContext_TypeDef *ctx);
+uint32_t    FIFO_MPSC_Dropped(FIFOMPSCContext_TypeDef *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef FIFO_MPSC_H */
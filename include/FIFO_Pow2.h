@@ -0,0 +1,96 @@
+/**
+ * @file FIFO_Pow2.h
+ * @author Matthew Philyaw (matthew.philyaw@gmail.com)
+ *
+ * @brief Power of two FIFO with compile time capacity
+ *
+ * FIFO_POW2_DEFINE generates a FIFO type and its api for one element type and
+ * capacity. The capacity is 2^sizeLog2 so positions are free running and a
+ * mask picks the slot, there is no compare and wrap per element and no
+ * BufferWidth multiply. The buffer lives inside the context and the index
+ * type is chosen by the caller, so a small ring costs two uint8_t or uint16_t
+ * positions on top of its data. A FIFOContext_TypeDef carries word sized
+ * positions, the buffer pointer and width, the overflow policy and its
+ * counters, and the stats with EN_FIFO_STATS.
+ *
+ * Like FIFOContext_TypeDef it is lock free for a single producer and a
+ * single consumer.
+ *
+ * @code
+ * // 32 bytes with 8 bit positions, 34 bytes of RAM in total
+ * FIFO_POW2_DEFINE(RxRing, uint8_t, 5, uint8_t)
+ *
+ * static RxRing_TypeDef rx;
+ *
+ * RxRing_Init(&rx);
+ * RxRing_Write(&rx, 0x55);
+ *
+ * uint8_t out;
+ * RxRing_Read(&rx, &out);
+ * @endcode
+ */
+#ifndef __FIFO_POW2_H__
+#define __FIFO_POW2_H__
+
+#include "FIFO.h"
+
+#ifdef __cplusplus
+#define FIFO_POW2_STATIC_ASSERT static_assert
+#else
+#define FIFO_POW2_STATIC_ASSERT _Static_assert
+#endif
+
+/**
+ * @brief Generate a power of two FIFO type named name##_TypeDef and its api
+ * @param name prefix for the generated type and functions
+ * @param type element type
+ * @param sizeLog2 capacity is 1 << sizeLog2 elements
+ * @param indexType unsigned type for the positions, must hold twice the capacity
+ */
+#define FIFO_POW2_DEFINE(name, type, sizeLog2, indexType) \
+FIFO_POW2_STATIC_ASSERT((sizeLog2) < (sizeof(indexType) * 8), #name " capacity does not fit " #indexType " positions"); \
+\
+typedef struct { \
+  volatile indexType WritePos;     /**< Free running write position, only modified by the producer */ \
+  volatile indexType ReadPos;      /**< Free running read position, only modified by the consumer */ \
+  type Buffer[1U << (sizeLog2)];   /**< Element storage */ \
+} TOKENPASTE2(name, _TypeDef); \
+\
+static inline void TOKENPASTE2(name, _Init)(TOKENPASTE2(name, _TypeDef) *ctx) { \
+  ctx->WritePos = 0; \
+  ctx->ReadPos = 0; \
+} \
+\
+static inline uint32_t TOKENPASTE2(name, _Count)(const TOKENPASTE2(name, _TypeDef) *ctx) { \
+  return (indexType)(ctx->WritePos - ctx->ReadPos); \
+} \
+\
+static inline uint32_t TOKENPASTE2(name, _Space)(const TOKENPASTE2(name, _TypeDef) *ctx) { \
+  return (1U << (sizeLog2)) - TOKENPASTE2(name, _Count)(ctx); \
+} \
+\
+static inline int_fast8_t TOKENPASTE2(name, _Write)(TOKENPASTE2(name, _TypeDef) *ctx, type val) { \
+  indexType writePos = ctx->WritePos; \
+  if ((indexType)(writePos - ctx->ReadPos) >= (1U << (sizeLog2))) { \
+    return -1; \
+  } \
+  FIFO_Barrier(); \
+  ctx->Buffer[writePos & ((1U << (sizeLog2)) - 1)] = val; \
+  FIFO_Barrier(); \
+  ctx->WritePos = (indexType)(writePos + 1); \
+  return 0; \
+} \
+\
+static inline int_fast8_t TOKENPASTE2(name, _Read)(TOKENPASTE2(name, _TypeDef) *ctx, type *ret) { \
+  indexType readPos = ctx->ReadPos; \
+  if (readPos == ctx->WritePos) { \
+    return -1; \
+  } \
+  FIFO_Barrier(); \
+  *ret = ctx->Buffer[readPos & ((1U << (sizeLog2)) - 1)]; \
+  FIFO_Barrier(); \
+  ctx->ReadPos = (indexType)(readPos + 1); \
+  return 0; \
+}
+
+#endif /* ifndef FIFO_POW2_H */
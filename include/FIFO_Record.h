@@ -0,0 +1,86 @@
+/**
+ * @file FIFO_Record.h
+ * @author Matthew Philyaw (matthew.philyaw@gmail.com)
+ *
+ * @brief Variable length record FIFO for whole frames
+ *
+ * Stores length prefixed frames back to back in a byte buffer. A frame is
+ * never split across the end of the buffer: when it doesn't fit in the tail
+ * the producer drops a pad marker there and starts the frame at index 0, so
+ * the consumer always gets one pointer and one length per frame and can
+ * parse it in place without a reassembly copy.
+ *
+ * Every record is a 4 byte length header followed by the frame, padded up to
+ * the next 4 bytes so headers and frames stay word aligned. Lock free for a
+ * single producer and a single consumer, same as FIFOContext_TypeDef.
+ *
+ * @code
+ * static uint32_t rxFrames[64]; // 256 bytes, word aligned
+ * static FIFORecordContext_TypeDef rx;
+ *
+ * FIFO_Record_Init(&rx, sizeof(rxFrames), rxFrames);
+ *
+ * // producer, receive straight into the ring
+ * void *region;
+ * if (!FIFO_Record_Reserve(&rx, 32, &region)) {
+ *   uint32_t length = ReceiveFrame(region, 32);
+ *   FIFO_Record_Commit(&rx, length);
+ * }
+ *
+ * // consumer
+ * const void *frame;
+ * uint32_t length;
+ * while (!FIFO_Record_Peek(&rx, &frame, &length)) {
+ *   HandleFrame(frame, length);
+ *   FIFO_Record_Release(&rx);
+ * }
+ * @endcode
+ */
+#ifndef __FIFO_RECORD_H__
+#define __FIFO_RECORD_H__
+
+#include "FIFO.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Bytes taken by the length header in front of every frame
+ */
+#define FIFO_RECORD_HEADER sizeof(uint32_t)
+
+/**
+ * @brief Buffer bytes one frame of length bytes occupies, header and padding included
+ */
+#define FIFO_RECORD_SIZE(length) ((FIFO_RECORD_HEADER + (length) + 3U) & ~3U)
+
+/**
+ * @brief Record FIFO Context
+ *
+ * Positions are byte offsets in [0, 2 * MaxSize) like FIFOContext_TypeDef.
+ */
+typedef struct {
+  uint32_t MaxSize;           /**< Size of Buffer in bytes, must be a multiple of 4 */
+  volatile uint32_t WritePos; /**< Write position in [0, 2 * MaxSize), only modified by the producer */
+  volatile uint32_t ReadPos;  /**< Read position in [0, 2 * MaxSize), only modified by the consumer */
+  uint32_t Skip;              /**< Tail bytes the reserved frame skips, only used by the producer */
+  uint32_t Reserved;          /**< Frame length of the pending reservation, only used by the producer */
+  volatile uint32_t Dropped;  /**< Frames that didn't fit, only modified by the producer */
+  uint8_t *Buffer;            /**< Word aligned storage @note it's on the caller to allocate it */
+} FIFORecordContext_TypeDef;
+
+int_fast8_t FIFO_Record_Init(FIFORecordContext_TypeDef *ctx, uint32_t maxSize, void *buffer);
+int_fast8_t FIFO_Record_Reserve(FIFORecordContext_TypeDef *ctx, uint32_t length, void **region);
+int_fast8_t FIFO_Record_Commit(FIFORecordContext_TypeDef *ctx, uint32_t length);
+int_fast8_t FIFO_Record_Write(FIFORecordContext_TypeDef *ctx, const void *source, uint32_t length);
+int_fast8_t FIFO_Record_Peek(FIFORecordContext_TypeDef *ctx, const void **frame, uint32_t *length);
+int_fast8_t FIFO_Record_Release(FIFORecordContext_TypeDef *ctx);
+uint32_t    FIFO_Record_Used(const FIFORecordContext_TypeDef *ctx);
+uint32_t    FIFO_Record_Dropped(const FIFORecordContext_TypeDef *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef FIFO_RECORD_H */
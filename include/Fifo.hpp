@@ -0,0 +1,358 @@
+/**
+ * @file Fifo.hpp
+ * @author Matthew Philyaw (matthew.philyaw@gmail.com)
+ *
+ * @brief Compile time typed FIFO
+ *
+ * Header only counterpart of FIFOContext_TypeDef for C++ code. The element
+ * type and capacity are template parameters, so every store and load is a
+ * plain typed access the compiler can inline, there is no void* buffer and
+ * no setter function pointer in the way. N must be a power of two, positions
+ * are free running and a mask picks the slot.
+ *
+ * Lock free for a single producer and a single consumer, same as the C FIFO.
+ * The overflow policy is a template parameter with the same meaning as
+ * FIFOOverflowPolicy_t, so the policy checks compile away.
+ *
+ * It is for C++ code with a ring whose size is known at build time. The USART
+ * rings stay on FIFOContext_TypeDef: their storage and size come from
+ * SerialConfig_TypeDef at Open, and SERIAL_RX_DMA picks overwrite-oldest at
+ * run time, neither of which a template parameter can do. Their receive ISR
+ * stores each byte in place with FIFO_WriteByte instead of a setter.
+ *
+ * @code
+ * static Fifo<uint8_t, 32> rx;
+ *
+ * rx.Init();
+ * rx.Push(0x55);
+ *
+ * uint8_t out;
+ * rx.Pop(out);
+ * @endcode
+ */
+#ifndef __FIFO_HPP__
+#define __FIFO_HPP__
+
+#include <stdint.h>
+#include <string.h>
+#include "FIFO.h"
+
+template <typename T, uint32_t N, FIFOOverflowPolicy_t Policy = FIFO_OVERFLOW_DROP_NEWEST>
+class Fifo {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "Fifo capacity must be a power of two");
+
+public:
+  /**
+   * @brief Reset both positions, the buffer contents are left as is
+   * @param signal optional callback raised from the producer on overflow
+   */
+  void Init(void (*signal)(void) = 0) {
+    writePos = 0;
+    readPos = 0;
+    dropped = 0;
+    onOverflow = signal;
+#ifdef EN_FIFO_STATS
+    memset(&stats, 0, sizeof(stats));
+#endif
+  }
+
+  /**
+   * @brief Number of elements lost to overflow since Init
+   */
+  uint32_t Dropped() const {
+    return dropped;
+  }
+
+  /**
+   * @brief Copy out the instrumentation counters, see FIFO_GetStats
+   *
+   * @return
+   * 0  -> out filled in\n
+   * -1 -> built without EN_FIFO_STATS
+   */
+  int_fast8_t GetStats(FIFOStats_TypeDef &out) const {
+#ifdef EN_FIFO_STATS
+    out = stats;
+    return 0;
+#else
+    (void)out;
+    return -1;
+#endif
+  }
+
+  /**
+   * @brief Number of elements waiting to be read
+   */
+  uint32_t Count() const {
+    return writePos - readPos;
+  }
+
+  /**
+   * @brief Number of free elements left to write
+   */
+  uint32_t Space() const {
+    return N - Count();
+  }
+
+  /**
+   * @brief Write one element, producer only
+   *
+   * @return
+   * 0  -> element written\n
+   * -1 -> FIFO is full and the element was dropped
+   */
+  int_fast8_t Push(const T &val) {
+    uint32_t pos = writePos;
+
+    if (pos - readPos >= N && !MakeRoom(1)) {
+      return -1;
+    }
+
+    FIFO_Barrier();
+    buffer[pos & (N - 1)] = val;
+    FIFO_Barrier();
+
+    writePos = pos + 1;
+    StatsWrite(1);
+    return 0;
+  }
+
+  /**
+   * @brief Read one element, consumer only
+   *
+   * @return
+   * 0  -> element read into ret\n
+   * -1 -> FIFO is empty
+   */
+  int_fast8_t Pop(T &ret) {
+    uint32_t pos;
+
+    do {
+      pos = readPos;
+
+      if (pos == writePos) {
+        StatsRead(0, 1);
+        return -1;
+      }
+
+      FIFO_Barrier();
+      ret = buffer[pos & (N - 1)];
+      FIFO_Barrier();
+    } while (PublishReadPos(pos, pos + 1));
+
+    StatsRead(1, 1);
+    return 0;
+  }
+
+  /**
+   * @brief Write up to count elements, producer only
+   *
+   * @return number of elements written
+   */
+  uint32_t PushN(const T *source, uint32_t count) {
+    uint32_t written = 0;
+
+    if (Policy == FIFO_OVERFLOW_OVERWRITE_OLDEST && count > N) {
+      dropped += count - N;
+      source += count - N;
+      count = N;
+    }
+
+    while (count) {
+      uint32_t pos = writePos;
+      uint32_t length = count;
+
+      if (length > N - (pos - readPos)) {
+        length = MakeRoom(length);
+      }
+
+      if (length == 0) {
+        break;
+      }
+
+      FIFO_Barrier();
+      for (uint32_t i = 0; i < length; i++) {
+        buffer[(pos + i) & (N - 1)] = source[i];
+      }
+      FIFO_Barrier();
+
+      writePos = pos + length;
+      StatsWrite(length);
+      written += length;
+      source += length;
+      count -= length;
+
+      if (Policy != FIFO_OVERFLOW_BLOCK) {
+        break;
+      }
+    }
+
+    return written;
+  }
+
+  /**
+   * @brief Read up to count elements, consumer only
+   *
+   * @return number of elements read
+   */
+  uint32_t PopN(T *destination, uint32_t count) {
+    uint32_t pos;
+    uint32_t length;
+
+    do {
+      pos = readPos;
+      uint32_t available = writePos - pos;
+
+      length = (count < available) ? count : available;
+
+      FIFO_Barrier();
+      for (uint32_t i = 0; i < length; i++) {
+        destination[i] = buffer[(pos + i) & (N - 1)];
+      }
+      FIFO_Barrier();
+    } while (PublishReadPos(pos, pos + length));
+
+    StatsRead(length, count);
+    return length;
+  }
+
+  /**
+   * @brief Point at the contiguous readable region, consumer only
+   *
+   * Same contract as FIFO_PeekContiguous, the region stops at the end of the
+   * buffer and stays owned by the FIFO until Consume is called.
+   *
+   * @return number of elements readable at region
+   */
+  uint32_t Peek(const T *&region) {
+    uint32_t pos = readPos;
+    uint32_t available = writePos - pos;
+    uint32_t index = pos & (N - 1);
+
+    FIFO_Barrier();
+    region = &buffer[index];
+
+    return (available < N - index) ? available : N - index;
+  }
+
+  /**
+   * @brief Release count elements after Peek, consumer only
+   *
+   * @return
+   * 0  -> elements released\n
+   * -1 -> count is larger than the elements available
+   */
+  int_fast8_t Consume(uint32_t count) {
+    uint32_t pos = readPos;
+
+    if (count > writePos - pos) {
+      return -1;
+    }
+
+    FIFO_Barrier();
+    if (PublishReadPos(pos, pos + count)) {
+      return -1;
+    }
+
+    StatsRead(count, count);
+    return 0;
+  }
+
+private:
+  /**
+   * @brief Publish a new read position, see PublishReadPos in FIFO.c
+   */
+  int_fast8_t PublishReadPos(uint32_t pos, uint32_t newPos) {
+    if (Policy != FIFO_OVERFLOW_OVERWRITE_OLDEST) {
+      readPos = newPos;
+      return 0;
+    }
+
+    return __atomic_compare_exchange_n(&readPos, &pos, newPos, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ? 0 : -1;
+  }
+
+  /**
+   * @brief Record count elements written, producer side
+   */
+  void StatsWrite(uint32_t count) {
+#ifdef EN_FIFO_STATS
+    stats.Writes += count;
+    FIFO_StatsSample(&stats, writePos - readPos, N);
+#else
+    (void)count;
+#endif
+  }
+
+  /**
+   * @brief Record count of requested elements read, see StatsRead in FIFO.c
+   */
+  void StatsRead(uint32_t count, uint32_t requested) {
+#ifdef EN_FIFO_STATS
+    stats.Reads += count;
+
+    if (count < requested) {
+      stats.Underflows++;
+    }
+#else
+    (void)count;
+    (void)requested;
+#endif
+  }
+
+  /**
+   * @brief Producer slow path when count elements do not fit, see MakeRoom in FIFO.c
+   *
+   * @return number of elements that may be written now
+   */
+  uint32_t MakeRoom(uint32_t count) {
+    bool signalled = false;
+
+#ifdef EN_FIFO_STATS
+    stats.Overflows++;
+#endif
+
+    for (;;) {
+      uint32_t pos = readPos;
+      uint32_t space = N - (writePos - pos);
+
+      if (count <= space) {
+        return count;
+      }
+
+      if (Policy == FIFO_OVERFLOW_OVERWRITE_OLDEST) {
+        if (__atomic_compare_exchange_n(&readPos, &pos, pos + (count - space), false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+          dropped += count - space;
+        }
+      }
+      else if (Policy == FIFO_OVERFLOW_BLOCK) {
+        if (space) {
+          return space;
+        }
+
+        if (!signalled && onOverflow) {
+          onOverflow();
+        }
+        signalled = true;
+      }
+      else {
+        dropped += count - space;
+
+        if (onOverflow) {
+          onOverflow();
+        }
+        return space;
+      }
+    }
+  }
+
+  volatile uint32_t writePos; /**< Free running write position, only modified by the producer */
+  volatile uint32_t readPos;  /**< Free running read position, only stored by the consumer, except under FIFO_OVERFLOW_OVERWRITE_OLDEST where both sides move it with a compare and swap */
+  volatile uint32_t dropped;  /**< Elements lost to overflow, only modified by the producer */
+  void (*onOverflow)(void);   /**< Optional overflow signal */
+#ifdef EN_FIFO_STATS
+  FIFOStats_TypeDef stats;    /**< Instrumentation, read it with GetStats */
+#endif
+  T buffer[N];                /**< Element storage */
+};
+
+#endif /* ifndef FIFO_HPP */
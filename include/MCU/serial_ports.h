@@ -0,0 +1,43 @@
+/**
+ * @file serial_ports.h
+ * @author Matthew Philyaw (matthew.philyaw@gmail.com)
+ *
+ * @brief Serial ports of the board, one SerialInterface per USART/UART
+ *
+ * Each port is only built when its EN_SERIAL_PORTx switch in common.h is
+ * defined. SERIAL_EVENT_IDLE needs SerialPorts_Tick hooked to SysTick with
+ * Tick_SetCallback.
+ */
+#ifndef __SERIAL_PORTS_H__
+#define __SERIAL_PORTS_H__
+
+#include "common.h"
+#include "serial_interface.h"
+
+#ifdef EN_SERIAL_PORT1
+extern SerialInterface SerialPort1; /**< USART1, TX PA9, RX PA10 */
+#endif
+
+#ifdef EN_SERIAL_PORT2
+extern SerialInterface SerialPort2; /**< USART2, TX PA2, RX PA3 */
+#endif
+
+#ifdef EN_SERIAL_PORT3
+extern SerialInterface SerialPort3; /**< USART3, TX PD8, RX PD9 */
+#endif
+
+#ifdef EN_SERIAL_PORT4
+extern SerialInterface SerialPort4; /**< UART4, TX PA0, RX PA1 */
+#endif
+
+#ifdef EN_SERIAL_PORT5
+extern SerialInterface SerialPort5; /**< UART5, TX PC12, RX PD2 */
+#endif
+
+#ifdef EN_SERIAL_PORT6
+extern SerialInterface SerialPort6; /**< USART6, TX PC6, RX PC7 */
+#endif
+
+void SerialPorts_Tick(void);
+
+#endif /* ifndef SERIAL_PORTS_H */
@@ -12,5 +12,6 @@ void 		    Tick_Init(void);
 uint32_t 	  Tick_GetMs(void);
 int_fast8_t Tick_DelayMs_NonBlocking(uint_fast8_t reset, TickType *config);
 void 		    Tick_DelayMs(uint32_t delayMs);
+void 		    Tick_SetCallback(void (*onTick)(void));
 
 #endif
@@ -0,0 +1,208 @@
+/**
+ * @file usart.h
+ * @author Matthew Philyaw (matthew.philyaw@gmail.com)
+ *
+ * @brief Table driven USART/UART driver shared by every serial port
+ *
+ * The driver code is written once against a UsartDescriptor_TypeDef, which
+ * names the peripheral, its clock, pins, IRQ and DMA streams, and a
+ * UsartContext_TypeDef holding the per port state. Ring storage is handed in
+ * by the caller at Open, see SerialConfig_TypeDef. USART_DEFINE_PORT
+ * wraps a descriptor in a SerialInterface, so every port looks like the
+ * original SerialPort3 to the application. The ports of this board are
+ * instantiated in MCU/serial_ports.c.
+ */
+#ifndef __USART_H__
+#define __USART_H__
+
+#include "common.h"
+#include "serial_interface.h"
+#include "FIFO.h"
+#include "FIFO_MPSC.h"
+#include "FIFO_Broadcast.h"
+
+/**
+ * @brief Everything that differs between serial peripherals, lives in flash
+ *
+ * The RX and TX streams must be on Dma and answer to DmaChannel.
+ */
+typedef struct {
+  USART_TypeDef *Usart;             /**< Peripheral */
+  IRQn_Type Irq;                    /**< Peripheral interrupt */
+  volatile uint32_t *ClockRegister; /**< RCC enable register of the peripheral, APB1ENR or APB2ENR */
+  uint32_t ClockMask;               /**< Enable bit in ClockRegister */
+
+  GPIO_TypeDef *TxPort;             /**< Port of the TX pin */
+  GPIO_TypeDef *RxPort;             /**< Port of the RX pin */
+  uint8_t TxPin;                    /**< TX pin number */
+  uint8_t RxPin;                    /**< RX pin number */
+  uint8_t AlternateFunction;        /**< AF number of both pins */
+  uint32_t GpioClockMask;           /**< RCC AHB1ENR bits of both ports */
+
+  GPIO_TypeDef *RtsPort;            /**< Port of the RTS pin, NULL when the port has no flow control lines */
+  GPIO_TypeDef *CtsPort;            /**< Port of the CTS pin */
+  uint8_t RtsPin;                   /**< RTS pin number, driven as a plain output */
+  uint8_t CtsPin;                   /**< CTS pin number, on AlternateFunction */
+  uint32_t FlowClockMask;           /**< RCC AHB1ENR bits of the RTS and CTS ports */
+
+  DMA_TypeDef *Dma;                 /**< DMA controller serving the streams below */
+  uint32_t DmaClockMask;            /**< RCC AHB1ENR bit of Dma */
+  uint32_t DmaChannel;              /**< CHSEL bits for both streams */
+  DMA_Stream_TypeDef *RxStream;     /**< Stream for SERIAL_RX_DMA */
+  uint8_t RxStreamIndex;            /**< Stream number of RxStream, picks its flags */
+  IRQn_Type RxStreamIrq;            /**< Interrupt of RxStream */
+  DMA_Stream_TypeDef *TxStream;     /**< Stream for SERIAL_TX_DMA */
+  uint8_t TxStreamIndex;            /**< Stream number of TxStream, picks its flags */
+  IRQn_Type TxStreamIrq;            /**< Interrupt of TxStream */
+} UsartDescriptor_TypeDef;
+
+/**
+ * @brief Baud rate register settings worked out by Usart_PlanBaud
+ */
+typedef struct {
+  uint32_t Brr;         /**< Value for the BRR register */
+  uint_fast8_t Over8;   /**< TRUE to set CR1 OVER8, 8 times instead of 16 times oversampling */
+  uint32_t Baudrate;    /**< Baudrate these settings give */
+  uint32_t ErrorPpm;    /**< Difference to the requested baudrate in parts per million */
+} UsartBaudPlan_TypeDef;
+
+/**
+ * @brief Run time state of one serial port
+ */
+typedef struct {
+  const UsartDescriptor_TypeDef *Descriptor; /**< Port this state belongs to */
+  uint_fast8_t IsOpen;                       /**< Internal flag for open status */
+  SerialResult_t LastError;                  /**< Last receive status seen by the ISR, or SERIAL_DMA_ERROR from the TX stream */
+  SerialErrorStats_TypeDef Errors;           /**< Receive error counters, only modified by the ISR */
+  volatile uint32_t RxGapPos;                /**< RX ring write position where bytes were lost */
+  volatile SerialResult_t RxGapResult;       /**< What GetByte/PeekBytes report at RxGapPos */
+  volatile uint32_t RxGapsMarked;            /**< Loss markers placed, only modified by the ISR */
+  volatile uint32_t RxGapsSeen;              /**< Loss markers reported, only modified by the reader */
+  SerialRxMode_t RxMode;                     /**< Receive path picked at Open */
+  SerialTxMode_t TxMode;                     /**< Transmit path picked at Open */
+  uint32_t Baudrate;                         /**< Baudrate programmed at Open */
+  SerialFlowControl_t FlowControl;           /**< Flow control picked at Open */
+  uint32_t RxHighWatermark;                  /**< RX ring fill that stops the other end */
+  uint32_t RxLowWatermark;                   /**< RX ring fill that lets it go on */
+  volatile uint8_t RxPaused;                 /**< Other end was stopped, set by the RX ISR and cleared by the reader */
+  uint8_t RxEscape;                          /**< Last byte received was SERIAL_ESCAPE, USART ISR only */
+  volatile uint8_t TxControl;                /**< SERIAL_XON/SERIAL_XOFF to send ahead of the TX ring, 0 for none */
+  uint8_t TxEscaped;                         /**< Second half of an escape sequence still to send, 0 for none */
+  volatile uint8_t TxPaused;                 /**< Other end sent XOFF, USART ISR only */
+  FIFOContext_TypeDef RxFifo;                /**< RX ring filled by the ISR or the RX DMA, drained by the application */
+  uint32_t RxDmaIndex;                       /**< Buffer index the RX DMA had reached when last published */
+  uint32_t RxPeekPos;                        /**< RxFifo.ReadPos as of the last Usart_PeekBytes, an overwrite since moved it on */
+  FIFOMPSCContext_TypeDef TxFifo;            /**< TX ring, any context may queue into it and the TX ISR drains it */
+  uint32_t TxDmaLength;                      /**< Bytes the running TX DMA transfer covers, 0 when idle */
+  volatile uint_fast8_t TxKick;              /**< Set by senders in SERIAL_TX_INTERRUPT mode before they pend Irq */
+  void (*TxCallback)(void);                  /**< Called once everything queued is out on the line */
+  volatile uint32_t Events;                  /**< SerialEvent_t bits raised, 0 while the rest is being changed */
+  uint32_t EventThreshold;                   /**< Bytes available for SERIAL_EVENT_COUNT */
+  uint8_t EventDelimiter;                    /**< Byte for SERIAL_EVENT_DELIMITER */
+  uint32_t EventIdleCycles;                  /**< Quiet time for SERIAL_EVENT_IDLE in DWT cycles */
+  void (*OnEvent)(uint32_t events);          /**< Receive event callback */
+  volatile uint32_t RxLastCycles;            /**< DWT cycle count when bytes last came in */
+  volatile uint_fast8_t RxIdleArmed;         /**< Bytes came in since the last SERIAL_EVENT_IDLE */
+  volatile uint_fast8_t IdleKick;            /**< Set by Usart_Tick before it pends Irq to raise SERIAL_EVENT_IDLE */
+  uint32_t RxScanReadPos;                    /**< Read position the line scan started from */
+  uint32_t RxScanned;                        /**< Bytes from RxScanReadPos known to hold no RxScanDelimiter */
+  uint8_t RxScanDelimiter;                   /**< Delimiter of the last line scan */
+  volatile uint_fast8_t RxPolling;           /**< SERIAL_RX_HYBRID is polling, RXNEIE is off and the readers drain DR */
+  volatile uint_fast8_t RxPollExit;          /**< Set by Usart_Tick before it pends Irq to go back to interrupts */
+  volatile uint32_t RxTickBytes;             /**< Bytes received since the last SysTick, SERIAL_RX_HYBRID only */
+  volatile uint_fast8_t RxPollWanted;        /**< Usart_PollRx was called since the last SysTick, polling is only entered while set */
+  FIFOBroadcastContext_TypeDef *volatile RxBroadcast; /**< Optional ring every received byte is also written to */
+} UsartContext_TypeDef;
+
+int_fast8_t    Usart_PlanBaud(uint32_t pclk, uint32_t baudrate, uint32_t tolerancePpm, UsartBaudPlan_TypeDef *plan);
+int_fast8_t    Usart_BaudFromEdges(const uint32_t *edges, uint32_t count, uint32_t clock, uint32_t *baudrate);
+SerialResult_t Usart_DetectBaudrate(UsartContext_TypeDef *ctx, uint32_t timeoutMs, uint32_t *baudrate);
+SerialResult_t Usart_Open(UsartContext_TypeDef *ctx, const SerialConfig_TypeDef *config);
+void           Usart_Close(UsartContext_TypeDef *ctx);
+uint_fast8_t   Usart_IsOpen(UsartContext_TypeDef *ctx);
+uint_fast8_t   Usart_RxBufferHasData(UsartContext_TypeDef *ctx);
+SerialResult_t Usart_SendByte(UsartContext_TypeDef *ctx, uint8_t source);
+SerialResult_t Usart_SendString(UsartContext_TypeDef *ctx, const char *source);
+SerialResult_t Usart_SendArray(UsartContext_TypeDef *ctx, const uint8_t *source, uint32_t length);
+int32_t        Usart_GetByte(UsartContext_TypeDef *ctx, uint8_t *destination, uint32_t length);
+int32_t        Usart_PeekBytes(UsartContext_TypeDef *ctx, const uint8_t **data);
+int32_t        Usart_ReadUntil(UsartContext_TypeDef *ctx, uint8_t delimiter, uint8_t *destination, uint32_t length);
+int32_t        Usart_PeekLine(UsartContext_TypeDef *ctx, uint8_t delimiter);
+uint32_t       Usart_PollRx(UsartContext_TypeDef *ctx);
+SerialResult_t Usart_ConsumeBytes(UsartContext_TypeDef *ctx, uint32_t length);
+uint32_t       Usart_GetRxDropped(UsartContext_TypeDef *ctx);
+SerialResult_t Usart_GetRxFifoStats(UsartContext_TypeDef *ctx, FIFOStats_TypeDef *stats);
+uint_fast8_t   Usart_IsTxBusy(UsartContext_TypeDef *ctx);
+void           Usart_SetTxCallback(UsartContext_TypeDef *ctx, void (*onComplete)(void));
+SerialResult_t Usart_GetLastError(UsartContext_TypeDef *ctx);
+SerialResult_t Usart_GetErrorStats(UsartContext_TypeDef *ctx, SerialErrorStats_TypeDef *stats);
+uint32_t       Usart_GetBaudrate(UsartContext_TypeDef *ctx);
+SerialResult_t Usart_SetEventCallback(UsartContext_TypeDef *ctx, const SerialEventConfig_TypeDef *config);
+void           Usart_SetRxBroadcast(UsartContext_TypeDef *ctx, FIFOBroadcastContext_TypeDef *broadcast);
+void           Usart_Tick(UsartContext_TypeDef *ctx);
+
+void Usart_IRQHandler(UsartContext_TypeDef *ctx);
+void Usart_RxDmaIRQHandler(UsartContext_TypeDef *ctx);
+void Usart_TxDmaIRQHandler(UsartContext_TypeDef *ctx);
+
+/**
+ * @brief Define a SerialInterface named name driven by descriptor
+ *
+ * Generates the port's UsartContext_TypeDef, name##_Context, and the
+ * argument free functions SerialInterface expects, each a one line call into
+ * the shared driver. The peripheral and DMA interrupt handlers still have to
+ * forward to Usart_IRQHandler, Usart_RxDmaIRQHandler and
+ * Usart_TxDmaIRQHandler with &name##_Context, and SysTick to Usart_Tick.
+ */
+#define USART_DEFINE_PORT(name, descriptor) \
+static UsartContext_TypeDef TOKENPASTE2(name, _Context) = { &(descriptor) }; \
+\
+static uint_fast8_t TOKENPASTE2(name, _IsOpen)(void) { return Usart_IsOpen(&TOKENPASTE2(name, _Context)); } \
+static uint_fast8_t TOKENPASTE2(name, _RxBufferHasData)(void) { return Usart_RxBufferHasData(&TOKENPASTE2(name, _Context)); } \
+static SerialResult_t TOKENPASTE2(name, _Open)(const SerialConfig_TypeDef *config) { return Usart_Open(&TOKENPASTE2(name, _Context), config); } \
+static void TOKENPASTE2(name, _Close)(void) { Usart_Close(&TOKENPASTE2(name, _Context)); } \
+static SerialResult_t TOKENPASTE2(name, _SendByte)(uint8_t source) { return Usart_SendByte(&TOKENPASTE2(name, _Context), source); } \
+static SerialResult_t TOKENPASTE2(name, _SendString)(const char *source) { return Usart_SendString(&TOKENPASTE2(name, _Context), source); } \
+static SerialResult_t TOKENPASTE2(name, _SendArray)(const uint8_t *source, uint32_t length) { return Usart_SendArray(&TOKENPASTE2(name, _Context), source, length); } \
+static int32_t TOKENPASTE2(name, _GetByte)(uint8_t *destination, uint32_t length) { return Usart_GetByte(&TOKENPASTE2(name, _Context), destination, length); } \
+static int32_t TOKENPASTE2(name, _PeekBytes)(const uint8_t **data) { return Usart_PeekBytes(&TOKENPASTE2(name, _Context), data); } \
+static SerialResult_t TOKENPASTE2(name, _ConsumeBytes)(uint32_t length) { return Usart_ConsumeBytes(&TOKENPASTE2(name, _Context), length); } \
+static uint32_t TOKENPASTE2(name, _GetRxDropped)(void) { return Usart_GetRxDropped(&TOKENPASTE2(name, _Context)); } \
+static SerialResult_t TOKENPASTE2(name, _GetRxFifoStats)(FIFOStats_TypeDef *stats) { return Usart_GetRxFifoStats(&TOKENPASTE2(name, _Context), stats); } \
+static uint_fast8_t TOKENPASTE2(name, _IsTxBusy)(void) { return Usart_IsTxBusy(&TOKENPASTE2(name, _Context)); } \
+static void TOKENPASTE2(name, _SetTxCallback)(void (*onComplete)(void)) { Usart_SetTxCallback(&TOKENPASTE2(name, _Context), onComplete); } \
+static SerialResult_t TOKENPASTE2(name, _GetErrorStats)(SerialErrorStats_TypeDef *stats) { return Usart_GetErrorStats(&TOKENPASTE2(name, _Context), stats); } \
+static uint32_t TOKENPASTE2(name, _GetBaudrate)(void) { return Usart_GetBaudrate(&TOKENPASTE2(name, _Context)); } \
+static SerialResult_t TOKENPASTE2(name, _DetectBaudrate)(uint32_t timeoutMs, uint32_t *baudrate) { return Usart_DetectBaudrate(&TOKENPASTE2(name, _Context), timeoutMs, baudrate); } \
+static SerialResult_t TOKENPASTE2(name, _SetEventCallback)(const SerialEventConfig_TypeDef *config) { return Usart_SetEventCallback(&TOKENPASTE2(name, _Context), config); } \
+static int32_t TOKENPASTE2(name, _ReadUntil)(uint8_t delimiter, uint8_t *destination, uint32_t length) { return Usart_ReadUntil(&TOKENPASTE2(name, _Context), delimiter, destination, length); } \
+static int32_t TOKENPASTE2(name, _PeekLine)(uint8_t delimiter) { return Usart_PeekLine(&TOKENPASTE2(name, _Context), delimiter); } \
+static uint32_t TOKENPASTE2(name, _PollRx)(void) { return Usart_PollRx(&TOKENPASTE2(name, _Context)); } \
+static void TOKENPASTE2(name, _SetRxBroadcast)(FIFOBroadcastContext_TypeDef *broadcast) { Usart_SetRxBroadcast(&TOKENPASTE2(name, _Context), broadcast); } \
+\
+SerialInterface name = { \
+  TOKENPASTE2(name, _IsOpen), \
+  TOKENPASTE2(name, _RxBufferHasData), \
+  TOKENPASTE2(name, _Open), \
+  TOKENPASTE2(name, _Close), \
+  TOKENPASTE2(name, _SendByte), \
+  TOKENPASTE2(name, _SendString), \
+  TOKENPASTE2(name, _SendArray), \
+  TOKENPASTE2(name, _GetByte), \
+  TOKENPASTE2(name, _PeekBytes), \
+  TOKENPASTE2(name, _ConsumeBytes), \
+  TOKENPASTE2(name, _GetRxDropped), \
+  TOKENPASTE2(name, _GetRxFifoStats), \
+  TOKENPASTE2(name, _IsTxBusy), \
+  TOKENPASTE2(name, _SetTxCallback), \
+  TOKENPASTE2(name, _GetErrorStats), \
+  TOKENPASTE2(name, _GetBaudrate), \
+  TOKENPASTE2(name, _DetectBaudrate), \
+  TOKENPASTE2(name, _SetEventCallback), \
+  TOKENPASTE2(name, _ReadUntil), \
+  TOKENPASTE2(name, _PeekLine), \
+  TOKENPASTE2(name, _PollRx), \
+  TOKENPASTE2(name, _SetRxBroadcast) \
+}
+
+#endif /* ifndef USART_H */
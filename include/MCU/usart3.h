@@ -1,9 +0,0 @@
-#ifndef __USART3_H__
-#define __USART3_H__
-
-#include "common.h"
-#include "serial_interface.h"
-
-extern SerialInterface SerialPort3;
-
-#endif /* ifndef USART3_H */
@@ -13,10 +13,18 @@
 #define COMPILED_DATA_TIME "[" __DATE__ " " __TIME__ "]"
 
 #define EN_DEBUG_INTERFACE
-#define USART_OVER_SAMPLE_16
+#define USART_BAUD_TOLERANCE_PPM 15000 // largest baudrate error Open accepts, 1.5% leaves room for the other end's clock
+#define USART_RX_HYBRID_BURST 32 // bytes within one SysTick that switch SERIAL_RX_HYBRID over to polling
+#define USART_RX_HYBRID_QUIET 4  // fewer bytes than this in a SysTick switch it back to interrupts
 
 #define FIFO_UINT8_T
+#define EN_FIFO_STATS // occupancy/throughput counters in every FIFO, remove to compile them out
 
-#define USART_MAX_BUFFER 20
+#define EN_SERIAL_PORT1 // USART1, remove any of these to compile the port out
+#define EN_SERIAL_PORT2 // USART2
+#define EN_SERIAL_PORT3 // USART3
+#define EN_SERIAL_PORT4 // UART4, takes PA0/PA1 so USART2 has no RTS/CTS while it is on
+#define EN_SERIAL_PORT5 // UART5
+#define EN_SERIAL_PORT6 // USART6
 
 #endif
@@ -11,6 +11,8 @@
 #define __SERIAL_INTERFACE__
 
 #include "common.h"
+#include "FIFO.h"
+#include "FIFO_Broadcast.h"
 
 /**
  * @brief SerialResult_t contains possible error codes the interface will return
@@ -49,21 +51,185 @@ typedef enum {
   SERIAL_PARITY_ERROR = -6,       /**< Parity error detected */
   SERIAL_NOISE_ERROR = - 7,       /**< Noise error detected */
   SERIAL_LINE_BREAK_ERROR = -8,   /**< Line break detected */
-  SERIAL_INVALID_PARAMETER = -9   /**< Invalid parameter passed to a serial interface function */
+  SERIAL_INVALID_PARAMETER = -9,  /**< Invalid parameter passed to a serial interface function */
+  SERIAL_BUFFER_FULL = -10,       /**< Receive ring was full and the incoming byte was dropped */
+  SERIAL_BAUD_UNREACHABLE = -11,  /**< Baudrate can't be generated closely enough from the peripheral clock */
+  SERIAL_DMA_ERROR = -12          /**< A DMA transfer failed, the bytes it was sending were dropped */
 } SerialResult_t;
 
+/**
+ * @brief How received bytes get from the data register into the receive ring
+ */
+typedef enum {
+  SERIAL_RX_INTERRUPT = 0,  /**< One RXNE interrupt per received byte */
+  SERIAL_RX_DMA,            /**< Circular DMA straight into the receive ring, published on half/full transfer and line idle */
+  SERIAL_RX_HYBRID          /**< RXNE interrupts until a burst while PollRx is being called, then the readers poll the data register until it calms down, for ports without a DMA stream */
+} SerialRxMode_t;
+
+/**
+ * @brief How SendByte, SendString and SendArray get bytes onto the line
+ *
+ * In the queued modes a sender in thread mode waits for room in the transmit
+ * ring. Called from an interrupt handler or callback they never wait, they
+ * queue what fits and return SERIAL_BUFFER_FULL for the rest.
+ */
+typedef enum {
+  SERIAL_TX_BLOCKING = 0,   /**< Wait on TXE for every byte, returns once the last byte is in the data register */
+  SERIAL_TX_DMA,            /**< Queue into the transmit ring and return, DMA drains it */
+  SERIAL_TX_INTERRUPT       /**< Queue into the transmit ring and return, the TXE interrupt drains it, for when no DMA stream is free */
+} SerialTxMode_t;
+
+/**
+ * @brief XON/XOFF control bytes and the escape of SERIAL_FLOW_XON_XOFF_BINARY
+ */
+#define SERIAL_XON    0x11U
+#define SERIAL_XOFF   0x13U
+#define SERIAL_ESCAPE 0x7DU
+
+/**
+ * @brief How the two ends stop each other sending
+ *
+ * The RX ring fill is checked as bytes are published, per byte in
+ * SERIAL_RX_INTERRUPT but only on half transfer, transfer complete and line
+ * idle in SERIAL_RX_DMA. Leave room above the high watermark for half a
+ * ring in DMA mode.
+ *
+ * XON/XOFF is handled in the USART ISR, so it needs SERIAL_RX_INTERRUPT and
+ * SERIAL_TX_INTERRUPT. A received XOFF holds the transmitter from the next
+ * byte on, XON releases it, neither lands in the RX ring. In binary mode a
+ * data byte equal to SERIAL_XON, SERIAL_XOFF or SERIAL_ESCAPE goes out as
+ * SERIAL_ESCAPE followed by the byte XOR 0x20, and is undone on receive.
+ */
+typedef enum {
+  SERIAL_FLOW_NONE = 0,         /**< No flow control */
+  SERIAL_FLOW_RTS_CTS,          /**< RTS follows the receive ring watermarks, CTS holds the transmitter */
+  SERIAL_FLOW_XON_XOFF,         /**< XOFF/XON sent at the receive ring watermarks, text only as they aren't escaped */
+  SERIAL_FLOW_XON_XOFF_BINARY   /**< As SERIAL_FLOW_XON_XOFF, with data bytes that collide escaped */
+} SerialFlowControl_t;
+
+/**
+ * @brief Bytes of TxBuffer a transmit ring of size bytes needs
+ *
+ * The transmit ring takes senders from any context, it keeps a ready flag
+ * next to every byte.
+ */
+#define SERIAL_TX_STORAGE_SIZE(size) (2U * (size))
+
+/**
+ * @brief Declare ring storage for a serial port
+ *
+ * Word aligned for the DMA, use SERIAL_BUFFER_IN to also name the linker
+ * section it goes in, for example ".noinit" to skip zeroing it at startup.
+ */
+#define SERIAL_BUFFER(name, size) uint8_t name[size] __attribute__((aligned(4)))
+#define SERIAL_BUFFER_IN(name, size, sectionName) uint8_t name[size] __attribute__((aligned(4), section(sectionName)))
+
+/**
+ * @brief Settings passed to Open
+ *
+ * The rings live in storage owned by the caller, so each port gets rings
+ * sized for its traffic. The storage must stay valid until Close.
+ *
+ * Example:
+ * @code
+ * static SERIAL_BUFFER(rxStorage, 256);
+ * static SERIAL_BUFFER_IN(txStorage, SERIAL_TX_STORAGE_SIZE(512), ".noinit");
+ *
+ * static const SerialConfig_TypeDef config = {
+ *   115200, SERIAL_RX_DMA, SERIAL_TX_DMA,
+ *   rxStorage, sizeof(rxStorage),
+ *   txStorage, 512
+ * };
+ *
+ * SomeSerialInstance.Open(&config);
+ * @endcode
+ */
+typedef struct {
+  uint32_t Baudrate;      /**< Desired baudrate */
+  SerialRxMode_t RxMode;  /**< Receive path, see SerialRxMode_t */
+  SerialTxMode_t TxMode;  /**< Transmit path, see SerialTxMode_t */
+  uint8_t *RxBuffer;      /**< Receive ring storage, also the circular DMA target in SERIAL_RX_DMA mode */
+  uint32_t RxSize;        /**< Size of RxBuffer in bytes, at most 0xFFFF in SERIAL_RX_DMA mode */
+  uint8_t *TxBuffer;      /**< Transmit ring storage of SERIAL_TX_STORAGE_SIZE(TxSize) bytes, unused in SERIAL_TX_BLOCKING mode */
+  uint32_t TxSize;        /**< Transmit ring size in bytes, must be a power of two */
+  SerialFlowControl_t FlowControl; /**< Flow control, see SerialFlowControl_t */
+  uint32_t RxHighWatermark;        /**< Receive ring fill that asks the other end to stop, 0 for half of RxSize */
+  uint32_t RxLowWatermark;         /**< Receive ring fill that lets it go on, 0 for a quarter of RxSize */
+} SerialConfig_TypeDef;
+
+/**
+ * @brief Receive error counters, cumulative since Open
+ *
+ * Each counts interrupts that saw the error flag. Bytes dropped because the
+ * receive ring was full are counted by GetRxDropped.
+ */
+typedef struct {
+  uint32_t Overrun;    /**< A byte arrived before the previous one was read, bytes were lost */
+  uint32_t Framing;    /**< No stop bit where one was expected */
+  uint32_t Parity;     /**< Parity check failed */
+  uint32_t Noise;      /**< Noise detected while sampling a byte */
+  uint32_t LineBreak;  /**< Break condition on the line */
+} SerialErrorStats_TypeDef;
+
+/**
+ * @brief Receive events, OR-ed together in SerialEventConfig_TypeDef.Events and in what OnEvent gets
+ */
+typedef enum {
+  SERIAL_EVENT_COUNT     = 0x01,  /**< Receive ring filled up to Threshold bytes */
+  SERIAL_EVENT_DELIMITER = 0x02,  /**< Delimiter byte received */
+  SERIAL_EVENT_IDLE      = 0x04   /**< Nothing received for IdleUs after the last byte */
+} SerialEvent_t;
+
+/**
+ * @brief Which receive events wake the application and how
+ *
+ * OnEvent runs in interrupt context, it should only note the events and let
+ * the main loop read. SERIAL_EVENT_COUNT fires when the ring fill crosses
+ * Threshold, not again until it dropped below and crosses it again. In
+ * SERIAL_RX_DMA mode bytes, and so all three events, only show up on half
+ * transfer, transfer complete and line idle.
+ */
+typedef struct {
+  uint32_t Events;                /**< SerialEvent_t bits to raise */
+  uint32_t Threshold;             /**< Bytes available for SERIAL_EVENT_COUNT */
+  uint8_t Delimiter;              /**< Byte for SERIAL_EVENT_DELIMITER, e.g. '\r' */
+  uint32_t IdleUs;                /**< Quiet time for SERIAL_EVENT_IDLE, checked on the line idle interrupt and every SysTick */
+  void (*OnEvent)(uint32_t events); /**< Called from interrupt context with the SerialEvent_t bits raised */
+} SerialEventConfig_TypeDef;
+
 /**
  * @brief SerialInterface struct represents an interface to USART device
+ *
+ * When received bytes are lost, to an overrun or a full receive ring, a
+ * marker is left in the receive stream at that point. GetByte and PeekBytes
+ * stop short of it, and once the reader reaches it one call returns
+ * SERIAL_OVER_RUN or SERIAL_BUFFER_FULL instead of a count. Reading resumes
+ * with the bytes received after the loss. Only one marker is held at a time,
+ * losses before the reader gets to it are folded into it.
  */
 typedef struct {
   uint_fast8_t   (*IsOpen)(void);                                       /**< Check if interface is open */
   uint_fast8_t   (*RxBufferHasData)(void);                              /**< Check if data is available @note other functions may return this */
-  SerialResult_t (*Open)(uint32_t baudrate);                            /**< Open interface and initialize with specified baudrate */
+  SerialResult_t (*Open)(const SerialConfig_TypeDef *config);          /**< Open interface and initialize with the specified settings */
   void           (*Close)(void);                                        /**< Closes interface */
   SerialResult_t (*SendByte)(uint8_t);                                  /**< Send one byte over the interface */
   SerialResult_t (*SendString)(const char *source);                     /**< Send a string over the interface */
   SerialResult_t (*SendArray)(const uint8_t *source, uint32_t length);  /**< Send an array of bytes over the interface */
   int32_t (*GetByte)(uint8_t *destination, uint32_t length);                      /**< Retrieve one byte from the interface */
+  int32_t (*PeekBytes)(const uint8_t **data);                           /**< Point at received bytes in place without copying */
+  SerialResult_t (*ConsumeBytes)(uint32_t length);                      /**< Release bytes returned by PeekBytes, SERIAL_OVER_RUN if SERIAL_RX_DMA overwrote them first */
+  uint32_t       (*GetRxDropped)(void);                                 /**< Number of received bytes dropped because the receive ring was full */
+  SerialResult_t (*GetRxFifoStats)(FIFOStats_TypeDef *stats);           /**< Receive ring occupancy counters, see FIFO_GetStats */
+  uint_fast8_t   (*IsTxBusy)(void);                                     /**< Check if queued bytes are still going out on the line */
+  void           (*SetTxCallback)(void (*onComplete)(void));            /**< Called from the ISR once everything queued is out on the line */
+  SerialResult_t (*GetErrorStats)(SerialErrorStats_TypeDef *stats);     /**< Receive error counters since Open */
+  uint32_t       (*GetBaudrate)(void);                                  /**< Baudrate actually programmed, 0 when closed */
+  SerialResult_t (*DetectBaudrate)(uint32_t timeoutMs, uint32_t *baudrate); /**< Measure the host's rate from a 0x55 or 0x7F sync character, before Open */
+  SerialResult_t (*SetEventCallback)(const SerialEventConfig_TypeDef *config); /**< Wake on receive events instead of polling, NULL to stop */
+  int32_t        (*ReadUntil)(uint8_t delimiter, uint8_t *destination, uint32_t length); /**< Copy out one line, 0 until a complete one is in */
+  int32_t        (*PeekLine)(uint8_t delimiter);                       /**< Length of the next complete line, searched in place */
+  uint32_t       (*PollRx)(void);                                       /**< SERIAL_RX_HYBRID, opt in to polling from a loop that doesn't sleep and take what the data register holds */
+  void           (*SetRxBroadcast)(FIFOBroadcastContext_TypeDef *broadcast); /**< Also write every received byte to a broadcast ring for extra readers, NULL to stop */
 } SerialInterface;
 
 #endif
@@ -6,29 +6,207 @@
  *
  */
 #include "FIFO.h"
+#include <string.h>
 
 #define AccessBuffer(buffer, index, index_width) ((uint8_t *)(buffer))+((index) * (index_width))
 
+/**
+ * @brief Word type for block copies, may alias whatever the buffer holds
+ */
+typedef uint32_t __attribute__((__may_alias__)) FIFOWord_t;
+
+/**
+ * @brief Map a position in [0, 2 * MaxSize) onto a buffer index
+ */
+static inline uint32_t PosToIndex(const FIFOContext_TypeDef *ctx, uint32_t pos) {
+  return (pos >= ctx->MaxSize) ? pos - ctx->MaxSize : pos;
+}
+
+/**
+ * @brief Advance a position by count elements (count <= MaxSize)
+ */
+static inline uint32_t AdvancePos(const FIFOContext_TypeDef *ctx, uint32_t pos, uint32_t count) {
+  pos += count;
+
+  if (pos >= (ctx->MaxSize << 1)) {
+    pos -= (ctx->MaxSize << 1);
+  }
+
+  return pos;
+}
+
+/**
+ * @brief Number of elements between the read and write positions
+ */
+static inline uint32_t PosDistance(const FIFOContext_TypeDef *ctx, uint32_t writePos, uint32_t readPos) {
+  return (writePos >= readPos) ? writePos - readPos : writePos + (ctx->MaxSize << 1) - readPos;
+}
+
+/**
+ * @brief Copy a block of bytes a word at a time when both ends are aligned
+ *
+ * newlib-nano's memcpy is the size optimized byte loop, so this does the
+ * word copy itself and only falls back to bytes for misaligned ends.
+ */
+static void CopyBlock(uint8_t *destination, const uint8_t *source, uint32_t length) {
+  if ((((uintptr_t)destination | (uintptr_t)source) & (sizeof(FIFOWord_t) - 1)) == 0) {
+    FIFOWord_t *wordDestination = (FIFOWord_t *)destination;
+    const FIFOWord_t *wordSource = (const FIFOWord_t *)source;
+
+    for ( ; length >= sizeof(FIFOWord_t); length -= sizeof(FIFOWord_t)) {
+      *wordDestination++ = *wordSource++;
+    }
+
+    destination = (uint8_t *)wordDestination;
+    source = (const uint8_t *)wordSource;
+  }
+
+  while (length--) {
+    *destination++ = *source++;
+  }
+}
+
+/**
+ * @brief Publish a new read position
+ *
+ * A plain store while the consumer owns ReadPos. Under
+ * FIFO_OVERFLOW_OVERWRITE_OLDEST the producer may have pushed ReadPos past
+ * readPos in the mean time, so it is a compare and swap instead.
+ *
+ * @return
+ * 0  -> position published\n
+ * -1 -> producer overtook the read, the element(s) read are stale
+ */
+static inline int_fast8_t PublishReadPos(FIFOContext_TypeDef *ctx, uint32_t readPos, uint32_t newPos) {
+  if (ctx->OverflowPolicy != FIFO_OVERFLOW_OVERWRITE_OLDEST) {
+    ctx->ReadPos = newPos;
+    return 0;
+  }
+
+  return __atomic_compare_exchange_n(&ctx->ReadPos, &readPos, newPos, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ? 0 : -1;
+}
+
+/**
+ * @brief Record count elements written, producer side
+ */
+static inline void StatsWrite(FIFOContext_TypeDef *ctx, uint32_t count, uint32_t writePos) {
+#ifdef EN_FIFO_STATS
+  ctx->Stats.Writes += count;
+  FIFO_StatsSample(&ctx->Stats, PosDistance(ctx, writePos, ctx->ReadPos), ctx->MaxSize);
+#endif
+}
+
+/**
+ * @brief Record count of requested elements read, consumer side
+ *
+ * A read that asked for elements and got fewer counts as one underflow, a
+ * zero length read is not a poll of anything and isn't counted.
+ */
+static inline void StatsRead(FIFOContext_TypeDef *ctx, uint32_t count, uint32_t requested) {
+#ifdef EN_FIFO_STATS
+  ctx->Stats.Reads += count;
+
+  if (count < requested) {
+    ctx->Stats.Underflows++;
+  }
+#endif
+}
+
+/**
+ * @brief Producer side slow path when count elements do not fit
+ *
+ * Applies the overflow policy of the context. For overwrite-oldest count must
+ * be <= MaxSize.
+ *
+ * @return number of elements that may be written now
+ */
+static uint32_t MakeRoom(FIFOContext_TypeDef *ctx, uint32_t count) {
+  uint_fast8_t signalled = FALSE;
+
+#ifdef EN_FIFO_STATS
+  ctx->Stats.Overflows++;
+#endif
+
+  for (;;) {
+    uint32_t readPos = ctx->ReadPos;
+    uint32_t space = ctx->MaxSize - PosDistance(ctx, ctx->WritePos, readPos);
+
+    if (count <= space) {
+      return count;
+    }
+
+    switch (ctx->OverflowPolicy) {
+      case FIFO_OVERFLOW_OVERWRITE_OLDEST:
+        // the consumer may move ReadPos at the same time, retry until one of us wins
+        if (__atomic_compare_exchange_n(&ctx->ReadPos, &readPos, AdvancePos(ctx, readPos, count - space),
+                                        FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+          ctx->Dropped += count - space;
+        }
+        break;
+
+      case FIFO_OVERFLOW_BLOCK:
+        if (space) {
+          return space;
+        }
+
+        if (!signalled && ctx->OnOverflow) {
+          ctx->OnOverflow(ctx);
+        }
+        signalled = TRUE;
+        break;
+
+      default:
+        ctx->Dropped += count - space;
+
+        if (ctx->OnOverflow) {
+          ctx->OnOverflow(ctx);
+        }
+        return space;
+    }
+  }
+}
+
 /**
  * @brief Initialize FIFO Context
  *
+ * The overflow policy defaults to FIFO_OVERFLOW_DROP_NEWEST without a signal,
+ * use FIFO_SetOverflowPolicy right after to pick another.
+ *
  * @note It's recommend to use the generated macros for the target data type instead of using this directly
  */
 int_fast8_t FIFO_Init(FIFOContext_TypeDef *ctx, uint32_t maxSize, uint32_t bufferWidth, void *buffer) {
-  if (!buffer) {
+  if (!buffer || maxSize == 0 || maxSize > (UINT32_MAX >> 1)) {
     return -1;
   }
 
   ctx->MaxSize = maxSize;
-  ctx->CurrentSize = 0;
   ctx->WritePos = 0;
   ctx->ReadPos = 0;
   ctx->BufferWidth = bufferWidth;
   ctx->Buffer = buffer;
+  ctx->OverflowPolicy = FIFO_OVERFLOW_DROP_NEWEST;
+  ctx->OnOverflow = NULL;
+  ctx->Dropped = 0;
+#ifdef EN_FIFO_STATS
+  memset(&ctx->Stats, 0, sizeof(ctx->Stats));
+#endif
 
   return 0;
 }
 
+/**
+ * @brief Choose what happens when writing to a full FIFO
+ * @param policy one of FIFOOverflowPolicy_t
+ * @param onOverflow optional signal, called from the producer when a drop-newest
+ * write loses elements or a blocking write starts waiting
+ *
+ * @note Call before the FIFO is shared between producer and consumer.
+ */
+void FIFO_SetOverflowPolicy(FIFOContext_TypeDef *ctx, FIFOOverflowPolicy_t policy, void (*onOverflow)(FIFOContext_TypeDef *ctx)) {
+  ctx->OverflowPolicy = policy;
+  ctx->OnOverflow = onOverflow;
+}
+
 /**
  * @brief Write value to FIFO
  *
@@ -38,25 +216,66 @@ int_fast8_t FIFO_Init(FIFOContext_TypeDef *ctx, uint32_t maxSize, uint32_t buffe
  * These setter functions are defined via ifdef switched on a per type basis
  * with the bodies defined in this module via macros.
  *
+ * Only the producer may call this. The element is stored before WritePos is
+ * published so the consumer never sees a slot that is not filled yet.
+ *
+ * @return
+ * 0  -> value written (possibly in place of the oldest element)\n
+ * -1 -> FIFO full and the value was dropped
+ *
  * @note It's recommended to use the Api macros for a given data type instead of using this
  * directly. Those macros will handle choosing the right setter for the data type in use.
  */
 int_fast8_t FIFO_Write(FIFOContext_TypeDef *ctx, void(* setFun)(void*, void*), void *val) {
-  if (ctx->CurrentSize >= ctx->MaxSize) {
+  uint32_t writePos = ctx->WritePos;
+
+  if (PosDistance(ctx, writePos, ctx->ReadPos) >= ctx->MaxSize && !MakeRoom(ctx, 1)) {
     return -1;
   }
 
-  void *addr = AccessBuffer(ctx->Buffer, ctx->WritePos, ctx->BufferWidth);
+  FIFO_Barrier();
+
+  void *addr = AccessBuffer(ctx->Buffer, PosToIndex(ctx, writePos), ctx->BufferWidth);
 
   setFun(addr, val);
 
-  ctx->CurrentSize++;
-  ctx->WritePos++;
+  FIFO_Barrier();
+
+  writePos = AdvancePos(ctx, writePos, 1);
+  ctx->WritePos = writePos;
 
-  if (ctx->WritePos >= ctx->MaxSize) {
-    ctx->WritePos = 0;
+  StatsWrite(ctx, 1, writePos);
+
+  return 0;
+}
+
+/**
+ * @brief Write one byte to a FIFO of uint8_t
+ *
+ * FIFO_Write with the store done in place instead of through a setter, for
+ * producers like a receive ISR that write a byte at a time. Same rules and
+ * return values as FIFO_Write.
+ *
+ * @note Only for a FIFO initialized with a bufferWidth of 1.
+ */
+int_fast8_t FIFO_WriteByte(FIFOContext_TypeDef *ctx, uint8_t value) {
+  uint32_t writePos = ctx->WritePos;
+
+  if (PosDistance(ctx, writePos, ctx->ReadPos) >= ctx->MaxSize && !MakeRoom(ctx, 1)) {
+    return -1;
   }
 
+  FIFO_Barrier();
+
+  ((uint8_t *)ctx->Buffer)[PosToIndex(ctx, writePos)] = value;
+
+  FIFO_Barrier();
+
+  writePos = AdvancePos(ctx, writePos, 1);
+  ctx->WritePos = writePos;
+
+  StatsWrite(ctx, 1, writePos);
+
   return 0;
 }
 
@@ -69,26 +288,302 @@ int_fast8_t FIFO_Write(FIFOContext_TypeDef *ctx, void(* setFun)(void*, void*), v
  * These getter functions are defined via ifdef switched on a per type basis
  * with the bodies defined in this module via macros.
  *
+ * Only the consumer may call this. The element is copied out before ReadPos is
+ * published so the producer never overwrites a slot that is still being read.
+ *
  * @note It's recommended to use the Api macros for a given data type instead of using this
  * directly. Those macros will handle choosing the right getter for the data type in use.
  */
 int_fast8_t FIFO_Read(FIFOContext_TypeDef *ctx, void(* getFun)(void*, void*), void *ret) {
-  if (ctx->CurrentSize <= 0) {
-    return -1;
+  uint32_t readPos;
+
+  do {
+    readPos = ctx->ReadPos;
+
+    if (ctx->WritePos == readPos) {
+      StatsRead(ctx, 0, 1);
+      return -1;
+    }
+
+    FIFO_Barrier();
+
+    void *addr = AccessBuffer(ctx->Buffer, PosToIndex(ctx, readPos), ctx->BufferWidth);
+
+    getFun(addr, ret);
+
+    FIFO_Barrier();
+  } while (PublishReadPos(ctx, readPos, AdvancePos(ctx, readPos, 1)));
+
+  StatsRead(ctx, 1, 1);
+
+  return 0;
+}
+
+/**
+ * @brief Write up to count elements from source to the FIFO
+ *
+ * The free span is filled in at most two block copies, one up to the end of
+ * the buffer and one from the start, instead of a setter call per element.
+ * When it does not all fit the overflow policy decides: drop-newest writes
+ * what fits, overwrite-oldest keeps the newest MaxSize elements and block
+ * waits until everything is written. Only the producer may call this.
+ *
+ * @return number of elements actually written
+ */
+uint32_t FIFO_WriteN(FIFOContext_TypeDef *ctx, const void *source, uint32_t count) {
+  uint32_t written = 0;
+
+  if (count > ctx->MaxSize && ctx->OverflowPolicy == FIFO_OVERFLOW_OVERWRITE_OLDEST) {
+    // the leading elements would be overwritten by the trailing ones anyway
+    ctx->Dropped += count - ctx->MaxSize;
+    source = (const uint8_t *)source + ((count - ctx->MaxSize) * ctx->BufferWidth);
+    count = ctx->MaxSize;
+  }
+
+  while (count) {
+    uint32_t writePos = ctx->WritePos;
+    uint32_t length = count;
+
+    if (length > ctx->MaxSize - PosDistance(ctx, writePos, ctx->ReadPos)) {
+      length = MakeRoom(ctx, length);
+    }
+
+    if (length == 0) {
+      break;
+    }
+
+    FIFO_Barrier();
+
+    uint32_t index = PosToIndex(ctx, writePos);
+    uint32_t first = ctx->MaxSize - index;
+
+    if (first > length) {
+      first = length;
+    }
+
+    CopyBlock(AccessBuffer(ctx->Buffer, index, ctx->BufferWidth), source, first * ctx->BufferWidth);
+    CopyBlock(ctx->Buffer, (const uint8_t *)source + (first * ctx->BufferWidth), (length - first) * ctx->BufferWidth);
+
+    FIFO_Barrier();
+
+    writePos = AdvancePos(ctx, writePos, length);
+    ctx->WritePos = writePos;
+
+    StatsWrite(ctx, length, writePos);
+
+    written += length;
+    count -= length;
+    source = (const uint8_t *)source + (length * ctx->BufferWidth);
+
+    // only a blocking write waits for room for the rest, MakeRoom has
+    // already counted whatever drop-newest left out
+    if (ctx->OverflowPolicy != FIFO_OVERFLOW_BLOCK) {
+      break;
+    }
+  }
+
+  return written;
+}
+
+/**
+ * @brief Read up to count elements from the FIFO into destination
+ *
+ * Mirror of FIFO_WriteN, the available span is copied out in at most two
+ * block copies. Only the consumer may call this.
+ *
+ * @return number of elements actually read
+ */
+uint32_t FIFO_ReadN(FIFOContext_TypeDef *ctx, void *destination, uint32_t count) {
+  uint32_t readPos;
+  uint32_t length;
+
+  do {
+    readPos = ctx->ReadPos;
+    uint32_t available = PosDistance(ctx, ctx->WritePos, readPos);
+
+    length = (count < available) ? count : available;
+
+    if (length == 0) {
+      StatsRead(ctx, 0, count);
+      return 0;
+    }
+
+    FIFO_Barrier();
+
+    uint32_t index = PosToIndex(ctx, readPos);
+    uint32_t first = ctx->MaxSize - index;
+
+    if (first > length) {
+      first = length;
+    }
+
+    CopyBlock(destination, AccessBuffer(ctx->Buffer, index, ctx->BufferWidth), first * ctx->BufferWidth);
+    CopyBlock((uint8_t *)destination + (first * ctx->BufferWidth), ctx->Buffer, (length - first) * ctx->BufferWidth);
+
+    FIFO_Barrier();
+  } while (PublishReadPos(ctx, readPos, AdvancePos(ctx, readPos, length)));
+
+  StatsRead(ctx, length, count);
+
+  return length;
+}
+
+/**
+ * @brief Get the contiguous free region at the write position
+ * @param[out] region set to the first free element
+ *
+ * Lets a producer (DMA, a parser, ...) fill the buffer in place. Nothing is
+ * visible to the consumer until FIFO_CommitWrite is called. The region stops
+ * at the end of the buffer, reserve again after committing to get the part
+ * at the start. Only the producer may call this.
+ *
+ * @return number of elements that can be written at region
+ */
+uint32_t FIFO_ReserveWrite(FIFOContext_TypeDef *ctx, void **region) {
+  uint32_t writePos = ctx->WritePos;
+  uint32_t readPos = ctx->ReadPos;
+  uint32_t space = ctx->MaxSize - PosDistance(ctx, writePos, readPos);
+  uint32_t index = PosToIndex(ctx, writePos);
+
+  FIFO_Barrier();
+
+  *region = AccessBuffer(ctx->Buffer, index, ctx->BufferWidth);
+
+  return (space < ctx->MaxSize - index) ? space : ctx->MaxSize - index;
+}
+
+/**
+ * @brief Publish count elements written in place after FIFO_ReserveWrite
+ *
+ * Under FIFO_OVERFLOW_OVERWRITE_OLDEST count may be more than the free space
+ * (up to MaxSize), for a writer like circular DMA that doesn't wait for room.
+ * The oldest elements it already overwrote are dropped.
+ *
+ * @return
+ * 0  -> elements are now visible to the consumer\n
+ * -1 -> count is larger than the free space, nothing is published
+ */
+int_fast8_t FIFO_CommitWrite(FIFOContext_TypeDef *ctx, uint32_t count) {
+  uint32_t writePos = ctx->WritePos;
+
+  if (count > ctx->MaxSize - PosDistance(ctx, writePos, ctx->ReadPos)) {
+    if (ctx->OverflowPolicy != FIFO_OVERFLOW_OVERWRITE_OLDEST || count > ctx->MaxSize) {
+      return -1;
+    }
+
+    MakeRoom(ctx, count);
   }
 
-  void *addr = AccessBuffer(ctx->Buffer, ctx->ReadPos, ctx->BufferWidth);
+  FIFO_Barrier();
 
-  getFun(addr, ret);
+  writePos = AdvancePos(ctx, writePos, count);
+  ctx->WritePos = writePos;
 
-  ctx->CurrentSize--;
-  ctx->ReadPos++;
+  StatsWrite(ctx, count, writePos);
+
+  return 0;
+}
+
+/**
+ * @brief Get the contiguous readable region at the read position
+ * @param[out] region set to the oldest element
+ *
+ * Lets a consumer parse or transmit straight out of the buffer. The elements
+ * stay owned by the FIFO until FIFO_Consume is called. The region stops at
+ * the end of the buffer, peek again after consuming to get the wrapped part.
+ * Only the consumer may call this.
+ *
+ * @note Under FIFO_OVERFLOW_OVERWRITE_OLDEST the producer may overwrite a
+ * peeked region at any time, FIFO_Consume then fails. Use FIFO_ReadN there.
+ *
+ * @return number of elements readable at region
+ */
+uint32_t FIFO_PeekContiguous(FIFOContext_TypeDef *ctx, const void **region) {
+  uint32_t readPos = ctx->ReadPos;
+  uint32_t writePos = ctx->WritePos;
+  uint32_t available = PosDistance(ctx, writePos, readPos);
+  uint32_t index = PosToIndex(ctx, readPos);
 
-  if (ctx->ReadPos >= ctx->MaxSize) {
-    ctx->ReadPos = 0;
+  FIFO_Barrier();
+
+  *region = AccessBuffer(ctx->Buffer, index, ctx->BufferWidth);
+
+  return (available < ctx->MaxSize - index) ? available : ctx->MaxSize - index;
+}
+
+/**
+ * @brief Release count elements after FIFO_PeekContiguous
+ *
+ * @return
+ * 0  -> elements released back to the producer\n
+ * -1 -> count is larger than the elements available or the producer overwrote
+ * them, nothing is released
+ */
+int_fast8_t FIFO_Consume(FIFOContext_TypeDef *ctx, uint32_t count) {
+  uint32_t readPos = ctx->ReadPos;
+
+  if (count > PosDistance(ctx, ctx->WritePos, readPos)) {
+    return -1;
   }
 
+  FIFO_Barrier();
+
+  if (PublishReadPos(ctx, readPos, AdvancePos(ctx, readPos, count))) {
+    return -1;
+  }
+
+  StatsRead(ctx, count, count);
+
+  return 0;
+}
+
+/**
+ * @brief Number of elements waiting to be read
+ *
+ * Safe to call from either side, the result is a snapshot that can only grow
+ * for the consumer and only shrink for the producer.
+ */
+uint32_t FIFO_Count(const FIFOContext_TypeDef *ctx) {
+  uint32_t writePos = ctx->WritePos;
+  uint32_t readPos = ctx->ReadPos;
+
+  return PosDistance(ctx, writePos, readPos);
+}
+
+/**
+ * @brief Number of free elements left to write
+ */
+uint32_t FIFO_Space(const FIFOContext_TypeDef *ctx) {
+  return ctx->MaxSize - FIFO_Count(ctx);
+}
+
+/**
+ * @brief Number of elements lost to overflow since init
+ */
+uint32_t FIFO_Dropped(const FIFOContext_TypeDef *ctx) {
+  return ctx->Dropped;
+}
+
+/**
+ * @brief Copy out the instrumentation counters
+ * @param[out] stats receives a snapshot of the counters
+ *
+ * Use it to size a FIFO from real traffic: Peak and the top histogram buckets
+ * show how close it ran to full, Overflows how often it was too small.
+ *
+ * @return
+ * 0  -> stats filled in\n
+ * -1 -> built without EN_FIFO_STATS, nothing to report
+ */
+int_fast8_t FIFO_GetStats(const FIFOContext_TypeDef *ctx, FIFOStats_TypeDef *stats) {
+#ifdef EN_FIFO_STATS
+  *stats = ctx->Stats;
   return 0;
+#else
+  (void)ctx;
+  (void)stats;
+  return -1;
+#endif
 }
 
 /**
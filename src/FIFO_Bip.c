@@ -0,0 +1,242 @@
+/**
+ * @file FIFO_Bip.c
+ * @author Matthew Philyaw (matthew.philyaw@gmail.com)
+ *
+ * @brief Bip buffer implementation
+ */
+#include "FIFO_Bip.h"
+
+/**
+ * @brief Contiguous readable bytes at the read position, consumer only
+ *
+ * Follows the watermark back to index 0 once the tail is drained.
+ *
+ * @return number of bytes readable at *readPos
+ */
+static uint32_t Readable(FIFOBipContext_TypeDef *ctx, uint32_t *readPos) {
+  uint32_t pos = ctx->ReadPos;
+  uint32_t writePos = ctx->WritePos;
+
+  FIFO_Barrier();
+
+  if (writePos >= pos) {
+    *readPos = pos;
+    return writePos - pos;
+  }
+
+  // producer wrapped, Watermark was published before WritePos
+  uint32_t watermark = ctx->Watermark;
+
+  if (pos == watermark) {
+    ctx->ReadPos = 0;
+    *readPos = 0;
+    return writePos;
+  }
+
+  *readPos = pos;
+  return watermark - pos;
+}
+
+/**
+ * @brief Record a reservation at index, producer only
+ */
+static inline void SetReservation(FIFOBipContext_TypeDef *ctx, uint32_t index, uint32_t count, void **region) {
+  ctx->ReserveIndex = index;
+  ctx->Reserved = count;
+  *region = ctx->Buffer + index;
+}
+
+/**
+ * @brief Initialize Bip FIFO Context
+ * @param maxSize size of buffer in bytes
+ * @param buffer storage
+ *
+ * @return
+ * 0  -> initialized\n
+ * -1 -> invalid parameter
+ */
+int_fast8_t FIFO_Bip_Init(FIFOBipContext_TypeDef *ctx, uint32_t maxSize, void *buffer) {
+  if (!buffer || maxSize < 2) {
+    return -1;
+  }
+
+  ctx->MaxSize = maxSize;
+  ctx->WritePos = 0;
+  ctx->ReadPos = 0;
+  ctx->Watermark = maxSize;
+  ctx->ReserveIndex = 0;
+  ctx->Reserved = 0;
+  ctx->Buffer = buffer;
+
+  return 0;
+}
+
+/**
+ * @brief Reserve count contiguous bytes, producer only
+ * @param[out] region set to the start of the reservation
+ *
+ * Nothing is visible to the consumer until FIFO_Bip_Commit. Reserving again
+ * before committing replaces the earlier reservation.
+ *
+ * @return
+ * 0  -> region reserved\n
+ * -1 -> no contiguous run of count bytes is free
+ */
+int_fast8_t FIFO_Bip_Reserve(FIFOBipContext_TypeDef *ctx, uint32_t count, void **region) {
+  uint32_t writePos = ctx->WritePos;
+  uint32_t readPos = ctx->ReadPos;
+
+  ctx->Reserved = 0;
+
+  if (writePos >= readPos) {
+    if (ctx->MaxSize - writePos >= count) {
+      SetReservation(ctx, writePos, count, region);
+      return 0;
+    }
+
+    // wrap, WritePos must stay short of ReadPos or it would read as empty
+    if (readPos > count) {
+      SetReservation(ctx, 0, count, region);
+      return 0;
+    }
+
+    return -1;
+  }
+
+  if (readPos - writePos > count) {
+    SetReservation(ctx, writePos, count, region);
+    return 0;
+  }
+
+  return -1;
+}
+
+/**
+ * @brief Reserve the largest contiguous free run, producer only
+ * @param[out] region set to the start of the reservation
+ *
+ * Prefers the run at the write position so the tail isn't given up while it
+ * still has room, handy for arming a DMA receive.
+ *
+ * @return number of bytes reserved, 0 when full
+ */
+uint32_t FIFO_Bip_ReserveMax(FIFOBipContext_TypeDef *ctx, void **region) {
+  uint32_t writePos = ctx->WritePos;
+  uint32_t readPos = ctx->ReadPos;
+  uint32_t count;
+
+  ctx->Reserved = 0;
+
+  if (writePos < readPos) {
+    count = readPos - writePos - 1;
+  }
+  else if (writePos < ctx->MaxSize) {
+    count = ctx->MaxSize - writePos;
+  }
+  else {
+    count = readPos ? readPos - 1 : 0;
+    writePos = 0;
+  }
+
+  if (count) {
+    SetReservation(ctx, writePos, count, region);
+  }
+
+  return count;
+}
+
+/**
+ * @brief Publish count bytes written into the reservation, producer only
+ *
+ * @return
+ * 0  -> bytes are now visible to the consumer\n
+ * -1 -> count is larger than the reservation
+ */
+int_fast8_t FIFO_Bip_Commit(FIFOBipContext_TypeDef *ctx, uint32_t count) {
+  uint32_t writePos = ctx->WritePos;
+
+  if (count > ctx->Reserved) {
+    return -1;
+  }
+
+  ctx->Reserved = 0;
+
+  if (count == 0) {
+    return 0;
+  }
+
+  FIFO_Barrier();
+
+  if (ctx->ReserveIndex != writePos) {
+    // wrapped, the consumer stops at the end of what's in the tail
+    ctx->Watermark = writePos;
+    FIFO_Barrier();
+  }
+
+  ctx->WritePos = ctx->ReserveIndex + count;
+
+  return 0;
+}
+
+/**
+ * @brief Copy count bytes in as one contiguous run, producer only
+ *
+ * @return
+ * 0  -> bytes queued\n
+ * -1 -> no contiguous run of count bytes is free, nothing is written
+ */
+int_fast8_t FIFO_Bip_Write(FIFOBipContext_TypeDef *ctx, const void *source, uint32_t count) {
+  const uint8_t *bytes = source;
+  uint8_t *region;
+
+  if (FIFO_Bip_Reserve(ctx, count, (void **)&region)) {
+    return -1;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    region[i] = bytes[i];
+  }
+
+  return FIFO_Bip_Commit(ctx, count);
+}
+
+/**
+ * @brief Get the contiguous readable region, consumer only
+ * @param[out] region set to the oldest byte
+ *
+ * The bytes stay owned by the FIFO until FIFO_Bip_Consume is called. Unlike
+ * FIFO_PeekContiguous the region is everything readable up to the
+ * watermark, there is no second fragment to come back for at the end of
+ * the buffer.
+ *
+ * @return number of bytes readable at region
+ */
+uint32_t FIFO_Bip_Peek(FIFOBipContext_TypeDef *ctx, const void **region) {
+  uint32_t readPos;
+  uint32_t length = Readable(ctx, &readPos);
+
+  *region = ctx->Buffer + readPos;
+
+  return length;
+}
+
+/**
+ * @brief Release count bytes after FIFO_Bip_Peek, consumer only
+ *
+ * @return
+ * 0  -> bytes released\n
+ * -1 -> count is larger than the region, nothing is released
+ */
+int_fast8_t FIFO_Bip_Consume(FIFOBipContext_TypeDef *ctx, uint32_t count) {
+  uint32_t readPos;
+
+  if (count > Readable(ctx, &readPos)) {
+    return -1;
+  }
+
+  FIFO_Barrier();
+
+  ctx->ReadPos = readPos + count;
+
+  return 0;
+}
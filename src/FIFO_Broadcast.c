@@ -0,0 +1,150 @@
+/**
+ * @file FIFO_Broadcast.c
+ * @author Matthew Philyaw (matthew.philyaw@gmail.com)
+ *
+ * @brief Broadcast byte ring implementation
+ */
+#include "FIFO_Broadcast.h"
+
+/**
+ * @brief Move a reader up to the oldest byte that is still safe to read
+ * @param writeClaim WriteClaim as last seen by the reader
+ */
+static inline void CatchUp(FIFOBroadcastReader_TypeDef *reader, uint32_t writeClaim) {
+  uint32_t oldest = writeClaim - reader->Fifo->MaxSize;
+
+  if ((int32_t)(oldest - reader->ReadPos) > 0) {
+    reader->Lost += oldest - reader->ReadPos;
+    reader->Overrun = TRUE;
+    reader->ReadPos = oldest;
+  }
+}
+
+/**
+ * @brief Initialize Broadcast FIFO Context
+ * @param maxSize size of buffer in bytes, must be a power of two
+ * @param buffer storage
+ *
+ * @return
+ * 0  -> initialized\n
+ * -1 -> invalid parameter
+ */
+int_fast8_t FIFO_Broadcast_Init(FIFOBroadcastContext_TypeDef *ctx, uint32_t maxSize, uint8_t *buffer) {
+  if (!buffer || maxSize == 0 || (maxSize & (maxSize - 1))) {
+    return -1;
+  }
+
+  ctx->MaxSize = maxSize;
+  ctx->WritePos = 0;
+  ctx->WriteClaim = 0;
+  ctx->Buffer = buffer;
+
+  return 0;
+}
+
+/**
+ * @brief Write count bytes, producer only
+ *
+ * Never blocks or fails, the oldest bytes are overwritten whether or not
+ * every reader has seen them.
+ */
+void FIFO_Broadcast_Write(FIFOBroadcastContext_TypeDef *ctx, const uint8_t *source, uint32_t count) {
+  uint32_t mask = ctx->MaxSize - 1;
+  uint32_t writePos = ctx->WritePos;
+
+  ctx->WriteClaim = writePos + count;
+
+  FIFO_Barrier();
+
+  // only the last MaxSize bytes can survive anyway
+  if (count > ctx->MaxSize) {
+    writePos += count - ctx->MaxSize;
+    source += count - ctx->MaxSize;
+    count = ctx->MaxSize;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    ctx->Buffer[(writePos + i) & mask] = source[i];
+  }
+
+  FIFO_Barrier();
+
+  ctx->WritePos = writePos + count;
+}
+
+/**
+ * @brief Attach a reader, it starts with the next byte written
+ */
+void FIFO_Broadcast_ReaderInit(FIFOBroadcastReader_TypeDef *reader, FIFOBroadcastContext_TypeDef *ctx) {
+  reader->Fifo = ctx;
+  reader->ReadPos = ctx->WritePos;
+  reader->Lost = 0;
+  reader->Overrun = FALSE;
+}
+
+/**
+ * @brief Read up to count bytes, only from the reader's owner
+ *
+ * Bytes this reader was too slow for are skipped and counted in Lost.
+ *
+ * @return number of bytes read
+ */
+uint32_t FIFO_Broadcast_ReadN(FIFOBroadcastReader_TypeDef *reader, uint8_t *destination, uint32_t count) {
+  FIFOBroadcastContext_TypeDef *ctx = reader->Fifo;
+  uint32_t mask = ctx->MaxSize - 1;
+
+  for (;;) {
+    uint32_t writePos = ctx->WritePos;
+
+    FIFO_Barrier();
+
+    CatchUp(reader, ctx->WriteClaim);
+
+    uint32_t readPos = reader->ReadPos;
+    uint32_t available = writePos - readPos;
+
+    if ((int32_t)available <= 0) {
+      return 0;
+    }
+
+    uint32_t length = (count < available) ? count : available;
+
+    for (uint32_t i = 0; i < length; i++) {
+      destination[i] = ctx->Buffer[(readPos + i) & mask];
+    }
+
+    FIFO_Barrier();
+
+    // the producer may have lapped us during the copy, then go again
+    uint32_t writeClaim = ctx->WriteClaim;
+
+    if ((int32_t)(writeClaim - ctx->MaxSize - readPos) <= 0) {
+      reader->ReadPos = readPos + length;
+      return length;
+    }
+
+    CatchUp(reader, writeClaim);
+  }
+}
+
+/**
+ * @brief Number of bytes written that this reader has not read yet
+ *
+ * More than MaxSize means the reader has already been overrun.
+ */
+uint32_t FIFO_Broadcast_Lag(const FIFOBroadcastReader_TypeDef *reader) {
+  return reader->Fifo->WritePos - reader->ReadPos;
+}
+
+/**
+ * @brief Check and clear the reader's overrun flag
+ *
+ * @return TRUE if bytes were lost since the last check
+ */
+uint_fast8_t FIFO_Broadcast_CheckOverrun(FIFOBroadcastReader_TypeDef *reader) {
+  uint_fast8_t overrun = reader->Overrun;
+
+  reader->Overrun = FALSE;
+
+  return overrun;
+}
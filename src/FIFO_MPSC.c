@@ -0,0 +1,229 @@
+/**
+ * @file FIFO_MPSC.c
+ * @author Matthew Philyaw (matthew.philyaw@gmail.com)
+ *
+ * @brief Multi producer/single consumer byte FIFO implementation
+ */
+#include "FIFO_MPSC.h"
+
+/**
+ * @brief Atomically replace *addr with desired if it still holds expected
+ *
+ * On the Cortex-M4 this is an LDREX/STREX pair, an exception between the two
+ * clears the monitor and the STREX fails, so we retry. The host build uses
+ * C11 atomics.
+ *
+ * @return TRUE if *addr was updated
+ */
+static inline uint_fast8_t CompareExchange(FIFOAtomic_t *addr, uint32_t expected, uint32_t desired) {
+#if defined(__arm__)
+  do {
+    if (__LDREXW(addr) != expected) {
+      __CLREX();
+      return FALSE;
+    }
+  } while (__STREXW(desired, addr));
+
+  return TRUE;
+#else
+  return atomic_compare_exchange_strong(addr, &expected, desired);
+#endif
+}
+
+/**
+ * @brief Atomically add value to *addr
+ */
+static inline void AtomicAdd(FIFOAtomic_t *addr, uint32_t value) {
+  uint32_t current;
+
+  do {
+    current = *addr;
+  } while (!CompareExchange(addr, current, current + value));
+}
+
+/**
+ * @brief Initialize MPSC FIFO Context
+ * @param maxSize number of bytes, must be a power of two
+ * @param buffer maxSize bytes of storage
+ * @param ready maxSize bytes for the ready flags
+ *
+ * @return
+ * 0  -> initialized\n
+ * -1 -> invalid parameter
+ */
+int_fast8_t FIFO_MPSC_Init(FIFOMPSCContext_TypeDef *ctx, uint32_t maxSize, uint8_t *buffer, uint8_t *ready) {
+  if (!buffer || !ready || maxSize == 0 || (maxSize & (maxSize - 1))) {
+    return -1;
+  }
+
+  ctx->MaxSize = maxSize;
+  ctx->Head = 0;
+  ctx->Tail = 0;
+  ctx->Dropped = 0;
+  ctx->Buffer = buffer;
+  ctx->Ready = ready;
+
+  for (uint32_t i = 0; i < maxSize; i++) {
+    ready[i] = FALSE;
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Write length bytes as one unit, safe from any number of producers
+ *
+ * Either all bytes go in back to back or none do.
+ *
+ * @return
+ * 0  -> bytes queued\n
+ * -1 -> not enough room, the bytes are counted in Dropped
+ */
+int_fast8_t FIFO_MPSC_Write(FIFOMPSCContext_TypeDef *ctx, const uint8_t *source, uint32_t length) {
+  uint32_t mask = ctx->MaxSize - 1;
+  uint32_t head;
+
+  if (length == 0) {
+    return 0;
+  }
+
+  do {
+    // Tail before Head so a stale Head can't make head - tail wrap
+    uint32_t tail = ctx->Tail;
+    FIFO_Barrier();
+    head = ctx->Head;
+
+    if (head - tail + length > ctx->MaxSize) {
+      AtomicAdd(&ctx->Dropped, length);
+      return -1;
+    }
+  } while (!CompareExchange(&ctx->Head, head, head + length));
+
+  for (uint32_t i = 0; i < length; i++) {
+    ctx->Buffer[(head + i) & mask] = source[i];
+  }
+
+  FIFO_Barrier();
+
+  for (uint32_t i = 0; i < length; i++) {
+    ctx->Ready[(head + i) & mask] = TRUE;
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Release count ready bytes at Tail back to the producers
+ */
+static void Release(FIFOMPSCContext_TypeDef *ctx, uint32_t tail, uint32_t count) {
+  uint32_t mask = ctx->MaxSize - 1;
+
+  for (uint32_t i = 0; i < count; i++) {
+    ctx->Ready[(tail + i) & mask] = FALSE;
+  }
+
+  FIFO_Barrier();
+
+  ctx->Tail = tail + count;
+}
+
+/**
+ * @brief Read up to count bytes, consumer only
+ *
+ * Stops at the first slot a producer has claimed but not finished.
+ *
+ * @return number of bytes read
+ */
+uint32_t FIFO_MPSC_ReadN(FIFOMPSCContext_TypeDef *ctx, uint8_t *destination, uint32_t count) {
+  uint32_t mask = ctx->MaxSize - 1;
+  uint32_t tail = ctx->Tail;
+  uint32_t length = 0;
+
+  // the ready flags at Tail are still set until Release, don't lap them
+  if (count > ctx->MaxSize) {
+    count = ctx->MaxSize;
+  }
+
+  while (length < count && ctx->Ready[(tail + length) & mask]) {
+    length++;
+  }
+
+  FIFO_Barrier();
+
+  for (uint32_t i = 0; i < length; i++) {
+    destination[i] = ctx->Buffer[(tail + i) & mask];
+  }
+
+  Release(ctx, tail, length);
+
+  return length;
+}
+
+/**
+ * @brief Point at the contiguous ready bytes at Tail, consumer only
+ *
+ * Same contract as FIFO_PeekContiguous, the region stops at the end of the
+ * buffer or the first unfinished slot and stays owned by the FIFO until
+ * FIFO_MPSC_Consume is called.
+ *
+ * @return number of bytes readable at region
+ */
+uint32_t FIFO_MPSC_PeekContiguous(FIFOMPSCContext_TypeDef *ctx, const uint8_t **region) {
+  uint32_t index = ctx->Tail & (ctx->MaxSize - 1);
+  uint32_t length = 0;
+
+  while (index + length < ctx->MaxSize && ctx->Ready[index + length]) {
+    length++;
+  }
+
+  FIFO_Barrier();
+
+  *region = &ctx->Buffer[index];
+
+  return length;
+}
+
+/**
+ * @brief Release count bytes after FIFO_MPSC_PeekContiguous, consumer only
+ *
+ * @return
+ * 0  -> bytes released\n
+ * -1 -> count is more than the ready bytes, nothing is released
+ */
+int_fast8_t FIFO_MPSC_Consume(FIFOMPSCContext_TypeDef *ctx, uint32_t count) {
+  uint32_t mask = ctx->MaxSize - 1;
+  uint32_t tail = ctx->Tail;
+
+  if (count > ctx->MaxSize) {
+    return -1;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    if (!ctx->Ready[(tail + i) & mask]) {
+      return -1;
+    }
+  }
+
+  Release(ctx, tail, count);
+
+  return 0;
+}
+
+/**
+ * @brief Number of bytes claimed by producers and not yet consumed
+ *
+ * Includes bytes still being written, so it is an upper bound on what
+ * FIFO_MPSC_ReadN would return.
+ */
+uint32_t FIFO_MPSC_Count(FIFOMPSCContext_TypeDef *ctx) {
+  uint32_t tail = ctx->Tail;
+  FIFO_Barrier();
+  return ctx->Head - tail;
+}
+
+/**
+ * @brief Number of bytes rejected because the ring was full
+ */
+uint32_t FIFO_MPSC_Dropped(FIFOMPSCContext_TypeDef *ctx) {
+  return ctx->Dropped;
+}
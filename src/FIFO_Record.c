@@ -0,0 +1,269 @@
+/**
+ * @file FIFO_Record.c
+ * @author Matthew Philyaw (matthew.philyaw@gmail.com)
+ *
+ * @brief Variable length record FIFO implementation
+ */
+#include "FIFO_Record.h"
+
+/**
+ * @brief Header value marking the rest of the buffer as unused, the next record is at index 0
+ */
+#define FIFO_RECORD_PAD 0xFFFFFFFFU
+
+/**
+ * @brief Reserved value while no reservation is pending
+ */
+#define FIFO_RECORD_NONE 0xFFFFFFFFU
+
+/**
+ * @brief Header word type, may alias whatever the frames hold
+ */
+typedef uint32_t __attribute__((__may_alias__)) FIFORecordHeader_t;
+
+/**
+ * @brief Map a position in [0, 2 * MaxSize) onto a buffer index
+ */
+static inline uint32_t PosToIndex(const FIFORecordContext_TypeDef *ctx, uint32_t pos) {
+  return (pos >= ctx->MaxSize) ? pos - ctx->MaxSize : pos;
+}
+
+/**
+ * @brief Advance a position by count bytes (count <= MaxSize)
+ */
+static inline uint32_t AdvancePos(const FIFORecordContext_TypeDef *ctx, uint32_t pos, uint32_t count) {
+  pos += count;
+
+  if (pos >= (ctx->MaxSize << 1)) {
+    pos -= (ctx->MaxSize << 1);
+  }
+
+  return pos;
+}
+
+/**
+ * @brief Number of bytes between the read and write positions
+ */
+static inline uint32_t PosDistance(const FIFORecordContext_TypeDef *ctx, uint32_t writePos, uint32_t readPos) {
+  return (writePos >= readPos) ? writePos - readPos : writePos + (ctx->MaxSize << 1) - readPos;
+}
+
+/**
+ * @brief Header word at a buffer index
+ */
+static inline FIFORecordHeader_t *Header(const FIFORecordContext_TypeDef *ctx, uint32_t index) {
+  return (FIFORecordHeader_t *)(ctx->Buffer + index);
+}
+
+/**
+ * @brief Step the read position over a pad marker, consumer only
+ *
+ * @return
+ * 0  -> ReadPos is at a frame\n
+ * -1 -> FIFO is empty
+ */
+static int_fast8_t SkipPad(FIFORecordContext_TypeDef *ctx, uint32_t *readPos) {
+  uint32_t pos = ctx->ReadPos;
+
+  if (pos == ctx->WritePos) {
+    return -1;
+  }
+
+  FIFO_Barrier();
+
+  uint32_t index = PosToIndex(ctx, pos);
+
+  if (*Header(ctx, index) == FIFO_RECORD_PAD) {
+    // the producer only pads when it writes a frame at index 0 right after
+    pos = AdvancePos(ctx, pos, ctx->MaxSize - index);
+    ctx->ReadPos = pos;
+  }
+
+  *readPos = pos;
+  return 0;
+}
+
+/**
+ * @brief Initialize Record FIFO Context
+ * @param maxSize size of buffer in bytes, a multiple of 4
+ * @param buffer word aligned storage
+ *
+ * @return
+ * 0  -> initialized\n
+ * -1 -> invalid parameter
+ */
+int_fast8_t FIFO_Record_Init(FIFORecordContext_TypeDef *ctx, uint32_t maxSize, void *buffer) {
+  if (!buffer || ((uintptr_t)buffer & 3U) || maxSize < FIFO_RECORD_SIZE(1) || (maxSize & 3U)) {
+    return -1;
+  }
+
+  ctx->MaxSize = maxSize;
+  ctx->WritePos = 0;
+  ctx->ReadPos = 0;
+  ctx->Skip = 0;
+  ctx->Reserved = FIFO_RECORD_NONE;
+  ctx->Dropped = 0;
+  ctx->Buffer = buffer;
+
+  return 0;
+}
+
+/**
+ * @brief Reserve room for a frame of up to length bytes, producer only
+ * @param[out] region set to where the frame goes, length contiguous bytes
+ *
+ * Nothing is visible to the consumer until FIFO_Record_Commit. Reserving
+ * again before committing replaces the earlier reservation.
+ *
+ * @return
+ * 0  -> region reserved\n
+ * -1 -> frame doesn't fit, counted in Dropped
+ */
+int_fast8_t FIFO_Record_Reserve(FIFORecordContext_TypeDef *ctx, uint32_t length, void **region) {
+  uint32_t writePos = ctx->WritePos;
+  uint32_t space = ctx->MaxSize - PosDistance(ctx, writePos, ctx->ReadPos);
+  uint32_t index = PosToIndex(ctx, writePos);
+  uint32_t tail = ctx->MaxSize - index;
+  uint32_t size = FIFO_RECORD_SIZE(length);
+
+  ctx->Reserved = FIFO_RECORD_NONE;
+
+  if (length > ctx->MaxSize - FIFO_RECORD_HEADER) {
+    ctx->Dropped++;
+    return -1;
+  }
+
+  // a frame never straddles the end, pad the tail and start over at 0
+  ctx->Skip = (size > tail) ? tail : 0;
+
+  if (ctx->Skip + size > space) {
+    ctx->Dropped++;
+    return -1;
+  }
+
+  if (ctx->Skip) {
+    index = 0;
+  }
+
+  ctx->Reserved = length;
+  *region = ctx->Buffer + index + FIFO_RECORD_HEADER;
+
+  return 0;
+}
+
+/**
+ * @brief Publish the reserved frame, producer only
+ * @param length bytes actually written, no more than reserved
+ *
+ * @return
+ * 0  -> frame is now visible to the consumer\n
+ * -1 -> nothing reserved or length is larger than the reservation
+ */
+int_fast8_t FIFO_Record_Commit(FIFORecordContext_TypeDef *ctx, uint32_t length) {
+  uint32_t writePos = ctx->WritePos;
+
+  if (ctx->Reserved == FIFO_RECORD_NONE || length > ctx->Reserved) {
+    return -1;
+  }
+
+  if (ctx->Skip) {
+    *Header(ctx, PosToIndex(ctx, writePos)) = FIFO_RECORD_PAD;
+    writePos = AdvancePos(ctx, writePos, ctx->Skip);
+  }
+
+  *Header(ctx, PosToIndex(ctx, writePos)) = length;
+
+  FIFO_Barrier();
+
+  ctx->WritePos = AdvancePos(ctx, writePos, FIFO_RECORD_SIZE(length));
+  ctx->Reserved = FIFO_RECORD_NONE;
+
+  return 0;
+}
+
+/**
+ * @brief Copy a frame in and publish it, producer only
+ *
+ * @return
+ * 0  -> frame queued\n
+ * -1 -> frame doesn't fit, counted in Dropped
+ */
+int_fast8_t FIFO_Record_Write(FIFORecordContext_TypeDef *ctx, const void *source, uint32_t length) {
+  const uint8_t *bytes = source;
+  uint8_t *region;
+
+  if (FIFO_Record_Reserve(ctx, length, (void **)&region)) {
+    return -1;
+  }
+
+  for (uint32_t i = 0; i < length; i++) {
+    region[i] = bytes[i];
+  }
+
+  return FIFO_Record_Commit(ctx, length);
+}
+
+/**
+ * @brief Get the oldest frame, consumer only
+ * @param[out] frame set to the first byte of the frame
+ * @param[out] length set to the frame length
+ *
+ * The frame stays owned by the FIFO until FIFO_Record_Release is called.
+ *
+ * @return
+ * 0  -> frame and length filled in\n
+ * -1 -> FIFO is empty
+ */
+int_fast8_t FIFO_Record_Peek(FIFORecordContext_TypeDef *ctx, const void **frame, uint32_t *length) {
+  uint32_t readPos;
+
+  if (SkipPad(ctx, &readPos)) {
+    return -1;
+  }
+
+  uint32_t index = PosToIndex(ctx, readPos);
+
+  *length = *Header(ctx, index);
+  *frame = ctx->Buffer + index + FIFO_RECORD_HEADER;
+
+  return 0;
+}
+
+/**
+ * @brief Drop the oldest frame, consumer only
+ *
+ * @return
+ * 0  -> frame released\n
+ * -1 -> FIFO is empty
+ */
+int_fast8_t FIFO_Record_Release(FIFORecordContext_TypeDef *ctx) {
+  uint32_t readPos;
+
+  if (SkipPad(ctx, &readPos)) {
+    return -1;
+  }
+
+  uint32_t length = *Header(ctx, PosToIndex(ctx, readPos));
+
+  FIFO_Barrier();
+
+  ctx->ReadPos = AdvancePos(ctx, readPos, FIFO_RECORD_SIZE(length));
+
+  return 0;
+}
+
+/**
+ * @brief Number of buffer bytes holding frames, headers and padding included
+ */
+uint32_t FIFO_Record_Used(const FIFORecordContext_TypeDef *ctx) {
+  uint32_t readPos = ctx->ReadPos;
+  FIFO_Barrier();
+  return PosDistance(ctx, ctx->WritePos, readPos);
+}
+
+/**
+ * @brief Number of frames rejected because they didn't fit
+ */
+uint32_t FIFO_Record_Dropped(const FIFORecordContext_TypeDef *ctx) {
+  return ctx->Dropped;
+}
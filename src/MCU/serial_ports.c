@@ -0,0 +1,310 @@
+/**
+ * @file serial_ports.c
+ * @author Matthew Philyaw (matthew.philyaw@gmail.com)
+ *
+ * @brief Descriptors, state and interrupt handlers of the board's serial ports
+ *
+ * Adding a port is a descriptor, a USART_DEFINE_PORT line and the handlers
+ * forwarding its interrupts to the shared driver in usart.c.
+ */
+#include "common.h"
+#include "MCU/usart.h"
+#include "MCU/serial_ports.h"
+
+#ifdef EN_SERIAL_PORT1
+/**
+ * @brief USART1 on PA9/PA10, DMA2 Stream2 RX and Stream7 TX on channel 4, RTS PA12 and CTS PA11
+ */
+static const UsartDescriptor_TypeDef Port1 = {
+  .Usart = USART1,
+  .Irq = USART1_IRQn,
+  .ClockRegister = &RCC->APB2ENR,
+  .ClockMask = RCC_APB2ENR_USART1EN,
+  .TxPort = GPIOA,
+  .RxPort = GPIOA,
+  .TxPin = 9,
+  .RxPin = 10,
+  .AlternateFunction = 7,
+  .GpioClockMask = RCC_AHB1ENR_GPIOAEN,
+  .RtsPort = GPIOA,
+  .CtsPort = GPIOA,
+  .RtsPin = 12,
+  .CtsPin = 11,
+  .FlowClockMask = RCC_AHB1ENR_GPIOAEN,
+  .Dma = DMA2,
+  .DmaClockMask = RCC_AHB1ENR_DMA2EN,
+  .DmaChannel = DMA_SxCR_CHSEL_2,
+  .RxStream = DMA2_Stream2,
+  .RxStreamIndex = 2,
+  .RxStreamIrq = DMA2_Stream2_IRQn,
+  .TxStream = DMA2_Stream7,
+  .TxStreamIndex = 7,
+  .TxStreamIrq = DMA2_Stream7_IRQn
+};
+
+USART_DEFINE_PORT(SerialPort1, Port1);
+
+void USART1_IRQHandler() {
+  Usart_IRQHandler(&SerialPort1_Context);
+}
+
+void DMA2_Stream2_IRQHandler() {
+  Usart_RxDmaIRQHandler(&SerialPort1_Context);
+}
+
+void DMA2_Stream7_IRQHandler() {
+  Usart_TxDmaIRQHandler(&SerialPort1_Context);
+}
+#endif
+
+#ifdef EN_SERIAL_PORT2
+/**
+ * @brief USART2 on PA2/PA3, DMA1 Stream5 RX and Stream6 TX on channel 4, RTS PA1 and CTS PA0
+ *
+ * PA0/PA1 are also UART4 TX/RX. With EN_SERIAL_PORT4 the RTS/CTS lines are
+ * left out, so UART4 keeps its pins and Open refuses SERIAL_FLOW_RTS_CTS.
+ */
+static const UsartDescriptor_TypeDef Port2 = {
+  .Usart = USART2,
+  .Irq = USART2_IRQn,
+  .ClockRegister = &RCC->APB1ENR,
+  .ClockMask = RCC_APB1ENR_USART2EN,
+  .TxPort = GPIOA,
+  .RxPort = GPIOA,
+  .TxPin = 2,
+  .RxPin = 3,
+  .AlternateFunction = 7,
+  .GpioClockMask = RCC_AHB1ENR_GPIOAEN,
+#ifndef EN_SERIAL_PORT4
+  .RtsPort = GPIOA,
+  .CtsPort = GPIOA,
+  .RtsPin = 1,
+  .CtsPin = 0,
+  .FlowClockMask = RCC_AHB1ENR_GPIOAEN,
+#endif
+  .Dma = DMA1,
+  .DmaClockMask = RCC_AHB1ENR_DMA1EN,
+  .DmaChannel = DMA_SxCR_CHSEL_2,
+  .RxStream = DMA1_Stream5,
+  .RxStreamIndex = 5,
+  .RxStreamIrq = DMA1_Stream5_IRQn,
+  .TxStream = DMA1_Stream6,
+  .TxStreamIndex = 6,
+  .TxStreamIrq = DMA1_Stream6_IRQn
+};
+
+USART_DEFINE_PORT(SerialPort2, Port2);
+
+void USART2_IRQHandler() {
+  Usart_IRQHandler(&SerialPort2_Context);
+}
+
+void DMA1_Stream5_IRQHandler() {
+  Usart_RxDmaIRQHandler(&SerialPort2_Context);
+}
+
+void DMA1_Stream6_IRQHandler() {
+  Usart_TxDmaIRQHandler(&SerialPort2_Context);
+}
+#endif
+
+#ifdef EN_SERIAL_PORT3
+/**
+ * @brief USART3 on PD8/PD9, DMA1 Stream1 RX and Stream3 TX on channel 4, RTS PD12 and CTS PD11
+ */
+static const UsartDescriptor_TypeDef Port3 = {
+  .Usart = USART3,
+  .Irq = USART3_IRQn,
+  .ClockRegister = &RCC->APB1ENR,
+  .ClockMask = RCC_APB1ENR_USART3EN,
+  .TxPort = GPIOD,
+  .RxPort = GPIOD,
+  .TxPin = 8,
+  .RxPin = 9,
+  .AlternateFunction = 7,
+  .GpioClockMask = RCC_AHB1ENR_GPIODEN,
+  .RtsPort = GPIOD,
+  .CtsPort = GPIOD,
+  .RtsPin = 12,
+  .CtsPin = 11,
+  .FlowClockMask = RCC_AHB1ENR_GPIODEN,
+  .Dma = DMA1,
+  .DmaClockMask = RCC_AHB1ENR_DMA1EN,
+  .DmaChannel = DMA_SxCR_CHSEL_2,
+  .RxStream = DMA1_Stream1,
+  .RxStreamIndex = 1,
+  .RxStreamIrq = DMA1_Stream1_IRQn,
+  .TxStream = DMA1_Stream3,
+  .TxStreamIndex = 3,
+  .TxStreamIrq = DMA1_Stream3_IRQn
+};
+
+USART_DEFINE_PORT(SerialPort3, Port3);
+
+void USART3_IRQHandler() {
+  Usart_IRQHandler(&SerialPort3_Context);
+}
+
+void DMA1_Stream1_IRQHandler() {
+  Usart_RxDmaIRQHandler(&SerialPort3_Context);
+}
+
+void DMA1_Stream3_IRQHandler() {
+  Usart_TxDmaIRQHandler(&SerialPort3_Context);
+}
+#endif
+
+#ifdef EN_SERIAL_PORT4
+/**
+ * @brief UART4 on PA0/PA1, DMA1 Stream2 RX and Stream4 TX on channel 4, no RTS/CTS lines
+ *
+ * PA0/PA1 are USART2 CTS/RTS as well, Port2 has no flow control while this
+ * port is enabled.
+ */
+static const UsartDescriptor_TypeDef Port4 = {
+  .Usart = UART4,
+  .Irq = UART4_IRQn,
+  .ClockRegister = &RCC->APB1ENR,
+  .ClockMask = RCC_APB1ENR_UART4EN,
+  .TxPort = GPIOA,
+  .RxPort = GPIOA,
+  .TxPin = 0,
+  .RxPin = 1,
+  .AlternateFunction = 8,
+  .GpioClockMask = RCC_AHB1ENR_GPIOAEN,
+  .Dma = DMA1,
+  .DmaClockMask = RCC_AHB1ENR_DMA1EN,
+  .DmaChannel = DMA_SxCR_CHSEL_2,
+  .RxStream = DMA1_Stream2,
+  .RxStreamIndex = 2,
+  .RxStreamIrq = DMA1_Stream2_IRQn,
+  .TxStream = DMA1_Stream4,
+  .TxStreamIndex = 4,
+  .TxStreamIrq = DMA1_Stream4_IRQn
+};
+
+USART_DEFINE_PORT(SerialPort4, Port4);
+
+void UART4_IRQHandler() {
+  Usart_IRQHandler(&SerialPort4_Context);
+}
+
+void DMA1_Stream2_IRQHandler() {
+  Usart_RxDmaIRQHandler(&SerialPort4_Context);
+}
+
+void DMA1_Stream4_IRQHandler() {
+  Usart_TxDmaIRQHandler(&SerialPort4_Context);
+}
+#endif
+
+#ifdef EN_SERIAL_PORT5
+/**
+ * @brief UART5 on PC12/PD2, DMA1 Stream0 RX and Stream7 TX on channel 4, no RTS/CTS lines
+ */
+static const UsartDescriptor_TypeDef Port5 = {
+  .Usart = UART5,
+  .Irq = UART5_IRQn,
+  .ClockRegister = &RCC->APB1ENR,
+  .ClockMask = RCC_APB1ENR_UART5EN,
+  .TxPort = GPIOC,
+  .RxPort = GPIOD,
+  .TxPin = 12,
+  .RxPin = 2,
+  .AlternateFunction = 8,
+  .GpioClockMask = RCC_AHB1ENR_GPIOCEN | RCC_AHB1ENR_GPIODEN,
+  .Dma = DMA1,
+  .DmaClockMask = RCC_AHB1ENR_DMA1EN,
+  .DmaChannel = DMA_SxCR_CHSEL_2,
+  .RxStream = DMA1_Stream0,
+  .RxStreamIndex = 0,
+  .RxStreamIrq = DMA1_Stream0_IRQn,
+  .TxStream = DMA1_Stream7,
+  .TxStreamIndex = 7,
+  .TxStreamIrq = DMA1_Stream7_IRQn
+};
+
+USART_DEFINE_PORT(SerialPort5, Port5);
+
+void UART5_IRQHandler() {
+  Usart_IRQHandler(&SerialPort5_Context);
+}
+
+void DMA1_Stream0_IRQHandler() {
+  Usart_RxDmaIRQHandler(&SerialPort5_Context);
+}
+
+void DMA1_Stream7_IRQHandler() {
+  Usart_TxDmaIRQHandler(&SerialPort5_Context);
+}
+#endif
+
+#ifdef EN_SERIAL_PORT6
+/**
+ * @brief USART6 on PC6/PC7, DMA2 Stream1 RX and Stream6 TX on channel 5, RTS PG12 and CTS PG13
+ */
+static const UsartDescriptor_TypeDef Port6 = {
+  .Usart = USART6,
+  .Irq = USART6_IRQn,
+  .ClockRegister = &RCC->APB2ENR,
+  .ClockMask = RCC_APB2ENR_USART6EN,
+  .TxPort = GPIOC,
+  .RxPort = GPIOC,
+  .TxPin = 6,
+  .RxPin = 7,
+  .AlternateFunction = 8,
+  .GpioClockMask = RCC_AHB1ENR_GPIOCEN,
+  .RtsPort = GPIOG,
+  .CtsPort = GPIOG,
+  .RtsPin = 12,
+  .CtsPin = 13,
+  .FlowClockMask = RCC_AHB1ENR_GPIOGEN,
+  .Dma = DMA2,
+  .DmaClockMask = RCC_AHB1ENR_DMA2EN,
+  .DmaChannel = DMA_SxCR_CHSEL_2 | DMA_SxCR_CHSEL_0,
+  .RxStream = DMA2_Stream1,
+  .RxStreamIndex = 1,
+  .RxStreamIrq = DMA2_Stream1_IRQn,
+  .TxStream = DMA2_Stream6,
+  .TxStreamIndex = 6,
+  .TxStreamIrq = DMA2_Stream6_IRQn
+};
+
+USART_DEFINE_PORT(SerialPort6, Port6);
+
+void USART6_IRQHandler() {
+  Usart_IRQHandler(&SerialPort6_Context);
+}
+
+void DMA2_Stream1_IRQHandler() {
+  Usart_RxDmaIRQHandler(&SerialPort6_Context);
+}
+
+void DMA2_Stream6_IRQHandler() {
+  Usart_TxDmaIRQHandler(&SerialPort6_Context);
+}
+#endif
+
+/**
+ * @brief Idle timeouts of every port, register with Tick_SetCallback
+ */
+void SerialPorts_Tick(void) {
+#ifdef EN_SERIAL_PORT1
+  Usart_Tick(&SerialPort1_Context);
+#endif
+#ifdef EN_SERIAL_PORT2
+  Usart_Tick(&SerialPort2_Context);
+#endif
+#ifdef EN_SERIAL_PORT3
+  Usart_Tick(&SerialPort3_Context);
+#endif
+#ifdef EN_SERIAL_PORT4
+  Usart_Tick(&SerialPort4_Context);
+#endif
+#ifdef EN_SERIAL_PORT5
+  Usart_Tick(&SerialPort5_Context);
+#endif
+#ifdef EN_SERIAL_PORT6
+  Usart_Tick(&SerialPort6_Context);
+#endif
+}
@@ -12,6 +12,7 @@
 #define TIMER_FREQUENCY_HZ 1000
 
 static volatile uint32_t TickCounter;
+static void (*volatile TickCallback)(void);
 
 /**
  * \brief Initialize systick
@@ -62,10 +63,23 @@ int_fast8_t Tick_DelayMs_NonBlocking(uint_fast8_t reset, TickType *config) {
   return TRUE;
 }
 
+/**
+ * \brief Run onTick every mili-second from the systick interrupt, NULL to stop
+ */
+void Tick_SetCallback(void (*onTick)(void)) {
+  TickCallback = onTick;
+}
+
 /**
  * \brief systick interrupt handler
  */
 void SysTick_Handler(void)
 {
     TickCounter++;
+
+    void (*onTick)(void) = TickCallback;
+
+    if (onTick) {
+        onTick();
+    }
 }
@@ -0,0 +1,1926 @@
+/**
+ * @file usart.c
+ * @author Matthew Philyaw (matthew.philyaw@gmail.com)
+ *
+ * @brief Table driven USART/UART driver implementation
+ */
+#include <string.h>
+#include "common.h"
+#include "MCU/usart.h"
+#include "MCU/tick.h"
+
+/**
+ * @brief Bit offset of a stream's flags in its LISR/HISR (LIFCR/HIFCR) word
+ */
+static const uint8_t DmaFlagShift[4] = { 0, 6, 16, 22 };
+
+#define DMA_FLAGS_ALL 0x3DU // FEIF, DMEIF, TEIF, HTIF, TCIF
+#define DMA_FLAG_TC   0x20U
+#define DMA_FLAG_TE   0x08U
+
+/**
+ * @brief Status register holding the flags of stream index
+ */
+static inline volatile uint32_t *DmaStatus(DMA_TypeDef *dma, uint8_t index) {
+  return (index < 4) ? &dma->LISR : &dma->HISR;
+}
+
+/**
+ * @brief Flag clear register of stream index
+ */
+static inline volatile uint32_t *DmaClear(DMA_TypeDef *dma, uint8_t index) {
+  return (index < 4) ? &dma->LIFCR : &dma->HIFCR;
+}
+
+/**
+ * @brief Clear every flag of stream index
+ */
+static inline void DmaClearFlags(DMA_TypeDef *dma, uint8_t index) {
+  *DmaClear(dma, index) = DMA_FLAGS_ALL << DmaFlagShift[index & 3];
+}
+
+/**
+ * @brief Clock of the APB bus the peripheral sits on, read back from RCC
+ */
+static uint32_t GetPclk(const UsartDescriptor_TypeDef *port) {
+  uint32_t prescaler;
+
+  SystemCoreClockUpdate();
+
+  if (port->ClockRegister == &RCC->APB2ENR) {
+    prescaler = (RCC->CFGR & RCC_CFGR_PPRE2) / RCC_CFGR_PPRE2_0;
+  }
+  else {
+    prescaler = (RCC->CFGR & RCC_CFGR_PPRE1) / RCC_CFGR_PPRE1_0;
+  }
+
+  // 0xx is HCLK undivided, 1xx divides by 2, 4, 8 or 16
+  if (prescaler & 4) {
+    return SystemCoreClock >> ((prescaler & 3) + 1);
+  }
+
+  return SystemCoreClock;
+}
+
+/**
+ * @brief Switch pin of port to alternate function af
+ */
+static void SetAlternateFunction(GPIO_TypeDef *port, uint8_t pin, uint8_t af) {
+  uint32_t shift = (pin & 7) * 4;
+
+  port->MODER &= ~(3U << (pin * 2));
+  port->MODER |= 2U << (pin * 2);
+  port->AFR[pin >> 3] &= ~(0x0FU << shift);
+  port->AFR[pin >> 3] |= (uint32_t)af << shift;
+}
+
+static void EnableISR(UsartContext_TypeDef *ctx) {
+  const UsartDescriptor_TypeDef *port = ctx->Descriptor;
+
+  NVIC_EnableIRQ(port->Irq);
+  NVIC_SetPriority(port->Irq, 1);
+
+  if (ctx->RxMode == SERIAL_RX_DMA) {
+    // same priority as the USART interrupt, both publish DMA progress and must not preempt each other
+    NVIC_EnableIRQ(port->RxStreamIrq);
+    NVIC_SetPriority(port->RxStreamIrq, 1);
+    port->Usart->CR1 |= USART_CR1_IDLEIE;
+    port->Usart->CR3 |= USART_CR3_EIE; // with DMAR set the errors only interrupt through EIE
+  }
+  else {
+    port->Usart->CR1 |= USART_CR1_RXNEIE;
+
+    if (ctx->Events & SERIAL_EVENT_IDLE) {
+      port->Usart->CR1 |= USART_CR1_IDLEIE;
+    }
+  }
+
+  if (ctx->TxMode == SERIAL_TX_DMA) {
+    // same priority again, the TX side is only ever touched from one ISR at a time
+    NVIC_EnableIRQ(port->TxStreamIrq);
+    NVIC_SetPriority(port->TxStreamIrq, 1);
+  }
+}
+
+static void DisableISR(UsartContext_TypeDef *ctx) {
+  const UsartDescriptor_TypeDef *port = ctx->Descriptor;
+
+  NVIC_DisableIRQ(port->Irq);
+  NVIC_DisableIRQ(port->RxStreamIrq);
+  NVIC_DisableIRQ(port->TxStreamIrq);
+}
+
+/**
+ * @brief Point the RX DMA at the RX ring and start it in circular mode
+ *
+ * The DMA then fills the ring on its own, the CPU only hears about it on
+ * half transfer, transfer complete and line idle.
+ */
+static void StartRxDma(UsartContext_TypeDef *ctx) {
+  const UsartDescriptor_TypeDef *port = ctx->Descriptor;
+  DMA_Stream_TypeDef *stream = port->RxStream;
+
+  RCC->AHB1ENR |= port->DmaClockMask;
+
+  stream->CR &= ~DMA_SxCR_EN;
+  while (stream->CR & DMA_SxCR_EN);
+
+  DmaClearFlags(port->Dma, port->RxStreamIndex);
+
+  stream->PAR = (uint32_t)(uintptr_t)&port->Usart->DR;
+  stream->M0AR = (uint32_t)(uintptr_t)ctx->RxFifo.Buffer;
+  stream->NDTR = ctx->RxFifo.MaxSize;
+  stream->FCR = 0; // direct mode
+  stream->CR = port->DmaChannel | DMA_SxCR_MINC | DMA_SxCR_CIRC | DMA_SxCR_HTIE | DMA_SxCR_TCIE;
+
+  ctx->RxDmaIndex = 0;
+
+  stream->CR |= DMA_SxCR_EN;
+  port->Usart->CR3 |= USART_CR3_DMAR;
+}
+
+/**
+ * @brief Stop the RX DMA
+ */
+static void StopRxDma(UsartContext_TypeDef *ctx) {
+  ctx->Descriptor->Usart->CR3 &= ~USART_CR3_DMAR;
+  ctx->Descriptor->RxStream->CR &= ~DMA_SxCR_EN;
+}
+
+/**
+ * @brief Leave a loss marker in the RX ring, ISR only
+ * @param position ring position the bytes went missing at
+ * @param result what the reader gets when it reaches the marker
+ *
+ * A marker the reader hasn't reached yet is kept, the loss is then reported
+ * at the earlier position.
+ */
+static void MarkRxGap(UsartContext_TypeDef *ctx, uint32_t position, SerialResult_t result) {
+  if (ctx->RxGapsMarked != ctx->RxGapsSeen) {
+    return;
+  }
+
+  ctx->RxGapPos = position;
+  ctx->RxGapResult = result;
+
+  FIFO_Barrier();
+
+  ctx->RxGapsMarked++;
+}
+
+/**
+ * @brief Limit a read to the bytes in front of the loss marker, reader only
+ * @param available bytes the read could return
+ *
+ * @return
+ * >= 0 -> bytes the read may return\n
+ * SERIAL_OVER_RUN, SERIAL_BUFFER_FULL -> reader is at the marker, it is now reported
+ */
+static int32_t RxBeforeGap(UsartContext_TypeDef *ctx, uint32_t available) {
+  if (ctx->RxGapsMarked == ctx->RxGapsSeen) {
+    return available;
+  }
+
+  FIFO_Barrier();
+
+  // positions run over [0, 2 * MaxSize), see FIFOContext_TypeDef
+  uint32_t range = 2 * ctx->RxFifo.MaxSize;
+  uint32_t readPos = ctx->RxFifo.ReadPos;
+  uint32_t distance = (ctx->RxGapPos >= readPos) ? ctx->RxGapPos - readPos : ctx->RxGapPos + range - readPos;
+
+  // further than what's buffered, the lost bytes were overwritten and the
+  // reader was pushed past the marker
+  if (distance == 0 || distance > FIFO_Count(&ctx->RxFifo)) {
+    SerialResult_t result = ctx->RxGapResult;
+
+    ctx->RxGapsSeen++;
+    return result;
+  }
+
+  return (available < distance) ? available : distance;
+}
+
+/**
+ * @brief Find the first delimiter in length bytes at data
+ *
+ * Compares a word at a time. A byte of data XOR the delimiter is zero where
+ * they match. With the Cortex-M4 SIMD instructions UADD8 of 0xFF sets the GE
+ * flag of every non zero byte and SEL turns the rest into 0xFF, otherwise
+ * the classic (x - 0x01..) & ~x & 0x80.. bit trick flags them. Either way
+ * the lowest flagged byte, the first in memory, is the match.
+ *
+ * @return index of the delimiter, length when there is none
+ */
+static uint32_t ScanDelimiter(const uint8_t *data, uint32_t length, uint8_t delimiter) {
+  uint32_t pattern = delimiter * 0x01010101U;
+  uint32_t i = 0;
+
+  for (; i < length && ((uintptr_t)(data + i) & 3); i++) {
+    if (data[i] == delimiter) {
+      return i;
+    }
+  }
+
+  for (; i + 4 <= length; i += 4) {
+    uint32_t word;
+
+    memcpy(&word, data + i, sizeof(word));
+    word ^= pattern;
+
+#if defined(__ARM_FEATURE_SIMD32)
+    __UADD8(word, 0xFFFFFFFFU);
+    uint32_t match = __SEL(0U, 0xFFFFFFFFU);
+#else
+    uint32_t match = (word - 0x01010101U) & ~word & 0x80808080U;
+#endif
+
+    if (match) {
+      return i + (__builtin_ctz(match) >> 3);
+    }
+  }
+
+  for (; i < length; i++) {
+    if (data[i] == delimiter) {
+      return i;
+    }
+  }
+
+  return length;
+}
+
+/**
+ * @brief Length of the line at the read position, reader only
+ * @param limit bytes from the read position that may be looked at
+ *
+ * Bytes an earlier call found free of the delimiter are not scanned again
+ * while the read position stays put, a line trickling in is only scanned
+ * once.
+ *
+ * @return bytes up to and including the delimiter, 0 when it isn't within limit
+ */
+static uint32_t ScanLine(UsartContext_TypeDef *ctx, uint8_t delimiter, uint32_t limit) {
+  const uint8_t *buffer = ctx->RxFifo.Buffer;
+  uint32_t size = ctx->RxFifo.MaxSize;
+  uint32_t readPos = ctx->RxFifo.ReadPos;
+
+  if (readPos != ctx->RxScanReadPos || delimiter != ctx->RxScanDelimiter) {
+    ctx->RxScanReadPos = readPos;
+    ctx->RxScanDelimiter = delimiter;
+    ctx->RxScanned = 0;
+  }
+
+  uint32_t scanned = (ctx->RxScanned < limit) ? ctx->RxScanned : limit;
+  uint32_t index = (readPos + scanned) % size;
+
+  while (scanned < limit) {
+    uint32_t run = (limit - scanned < size - index) ? limit - scanned : size - index;
+    uint32_t found = ScanDelimiter(buffer + index, run, delimiter);
+
+    if (found < run) {
+      ctx->RxScanned = scanned + found;
+      return scanned + found + 1;
+    }
+
+    scanned += run;
+    index = 0;
+  }
+
+  if (scanned > ctx->RxScanned) {
+    ctx->RxScanned = scanned;
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Count the receive errors flagged in sr and record the last status
+ */
+static void CountRxErrors(UsartContext_TypeDef *ctx, uint32_t sr) {
+  SerialResult_t status = SERIAL_SUCCESS;
+
+  if (sr & USART_SR_ORE) {
+    ctx->Errors.Overrun++;
+    status = SERIAL_OVER_RUN;
+  }
+
+  if (sr & USART_SR_NE) {
+    ctx->Errors.Noise++;
+    status = SERIAL_NOISE_ERROR;
+  }
+
+  if (sr & USART_SR_LBD) {
+    ctx->Errors.LineBreak++;
+    status = SERIAL_LINE_BREAK_ERROR;
+  }
+
+  if (sr & USART_SR_PE) {
+    ctx->Errors.Parity++;
+    status = SERIAL_PARITY_ERROR;
+  }
+
+  if (sr & USART_SR_FE) {
+    ctx->Errors.Framing++;
+    status = SERIAL_FRAMING_ERROR;
+  }
+
+  ctx->LastError = status;
+}
+
+/**
+ * @brief Drive RTS, it is active low so asserted lets the other end send
+ */
+static inline void SetRts(const UsartDescriptor_TypeDef *port, uint_fast8_t asserted) {
+  port->RtsPort->BSRR = asserted ? (1U << (port->RtsPin + 16)) : (1U << port->RtsPin);
+}
+
+/**
+ * @brief Tell the other end to stop or go on
+ * @param go TRUE to let it send again
+ *
+ * XON/XOFF jump the TX ring, TxInterrupt sends them ahead of queued data.
+ */
+static void SignalRxFlow(UsartContext_TypeDef *ctx, uint_fast8_t go) {
+  if (ctx->FlowControl == SERIAL_FLOW_RTS_CTS) {
+    SetRts(ctx->Descriptor, go);
+    return;
+  }
+
+  ctx->TxControl = go ? SERIAL_XON : SERIAL_XOFF;
+  ctx->Descriptor->Usart->CR1 |= USART_CR1_TXEIE;
+}
+
+/**
+ * @brief Stop the other end once the RX ring reaches the high watermark, ISR only
+ *
+ * The hardware RTS of the USART only tracks the data register, this one
+ * tracks the ring so the other end stops while there is still room for
+ * what it has in flight.
+ */
+static inline void RxFlowProduced(UsartContext_TypeDef *ctx) {
+  if (ctx->FlowControl == SERIAL_FLOW_NONE || ctx->RxPaused) {
+    return;
+  }
+
+  if (FIFO_Count(&ctx->RxFifo) >= ctx->RxHighWatermark) {
+    SignalRxFlow(ctx, FALSE);
+    ctx->RxPaused = TRUE;
+  }
+}
+
+/**
+ * @brief Let the other end go on once the RX ring drained to the low watermark, reader only
+ */
+static void RxFlowConsumed(UsartContext_TypeDef *ctx) {
+  if (!ctx->RxPaused || FIFO_Count(&ctx->RxFifo) > ctx->RxLowWatermark) {
+    return;
+  }
+
+  // the ISR may refill and pause between the check and the write, so check
+  // again with it held off
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  if (FIFO_Count(&ctx->RxFifo) <= ctx->RxLowWatermark) {
+    SignalRxFlow(ctx, TRUE);
+    ctx->RxPaused = FALSE;
+  }
+
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief Take XON/XOFF and escapes out of the received stream, USART ISR only
+ * @param[in,out] data received byte, unescaped on return
+ *
+ * @return
+ * TRUE -> data was a control byte and is not to be stored\n
+ * FALSE -> data is a data byte
+ */
+static uint_fast8_t RxSoftwareFlow(UsartContext_TypeDef *ctx, uint8_t *data) {
+  if (ctx->RxEscape) {
+    ctx->RxEscape = FALSE;
+    *data ^= 0x20;
+    return FALSE;
+  }
+
+  switch (*data) {
+    case SERIAL_XOFF:
+      ctx->TxPaused = TRUE;
+      return TRUE;
+
+    case SERIAL_XON:
+      ctx->TxPaused = FALSE;
+
+      // only wake the TX ISR with something to send, an idle wake would arm
+      // TC and report a completion that never happened
+      if (FIFO_MPSC_Count(&ctx->TxFifo) || ctx->TxEscaped) {
+        ctx->Descriptor->Usart->CR1 |= USART_CR1_TXEIE;
+      }
+      return TRUE;
+
+    case SERIAL_ESCAPE:
+      if (ctx->FlowControl == SERIAL_FLOW_XON_XOFF_BINARY) {
+        ctx->RxEscape = TRUE;
+        return TRUE;
+      }
+      return FALSE;
+
+    default:
+      return FALSE;
+  }
+}
+
+/**
+ * @brief Set up the RTS and CTS pins of the port for SERIAL_FLOW_RTS_CTS
+ *
+ * RTS is a plain output driven by RxFlowProduced/RxFlowConsumed. CTS goes to
+ * the USART with CTSE set, so the hardware holds the next byte in all three
+ * transmit modes while the other end has it deasserted.
+ */
+static void InitFlowControl(UsartContext_TypeDef *ctx) {
+  const UsartDescriptor_TypeDef *port = ctx->Descriptor;
+
+  RCC->AHB1ENR |= port->FlowClockMask;
+
+  SetRts(port, TRUE);
+  port->RtsPort->MODER &= ~(3U << (port->RtsPin * 2));
+  port->RtsPort->MODER |= 1U << (port->RtsPin * 2);
+
+  SetAlternateFunction(port->CtsPort, port->CtsPin, port->AlternateFunction);
+  port->Usart->CR3 |= USART_CR3_CTSE;
+}
+
+/**
+ * @brief Check count bytes of the RX ring from buffer index start for the event delimiter
+ */
+static uint_fast8_t RxHasDelimiter(UsartContext_TypeDef *ctx, uint32_t start, uint32_t count) {
+  const uint8_t *buffer = ctx->RxFifo.Buffer;
+  uint32_t size = ctx->RxFifo.MaxSize;
+  uint32_t first = (count < size - start) ? count : size - start;
+
+  return memchr(buffer + start, ctx->EventDelimiter, first) ||
+         (count > first && memchr(buffer, ctx->EventDelimiter, count - first));
+}
+
+/**
+ * @brief Raise the receive events added bytes just published trigger, ISR only
+ * @param added bytes just added to the RX ring
+ * @param delimiter TRUE when the event delimiter was among them
+ */
+static void RaiseRxEvents(UsartContext_TypeDef *ctx, uint32_t added, uint_fast8_t delimiter) {
+  uint32_t events = ctx->Events;
+  uint32_t raised = 0;
+
+  if (!events || !added) {
+    return;
+  }
+
+  if (events & SERIAL_EVENT_IDLE) {
+    ctx->RxLastCycles = DWT->CYCCNT;
+    ctx->RxIdleArmed = TRUE;
+  }
+
+  // only on the way up through the threshold
+  if (events & SERIAL_EVENT_COUNT) {
+    uint32_t count = FIFO_Count(&ctx->RxFifo);
+
+    if (count >= ctx->EventThreshold && count < ctx->EventThreshold + added) {
+      raised |= SERIAL_EVENT_COUNT;
+    }
+  }
+
+  if (delimiter) {
+    raised |= SERIAL_EVENT_DELIMITER;
+  }
+
+  if (raised) {
+    ctx->OnEvent(raised);
+  }
+}
+
+/**
+ * @brief Raise SERIAL_EVENT_IDLE if the line was quiet long enough, USART ISR only
+ */
+static void RaiseRxIdle(UsartContext_TypeDef *ctx) {
+  if (!(ctx->Events & SERIAL_EVENT_IDLE) || !ctx->RxIdleArmed) {
+    return;
+  }
+
+  if (DWT->CYCCNT - ctx->RxLastCycles >= ctx->EventIdleCycles) {
+    ctx->RxIdleArmed = FALSE;
+    ctx->OnEvent(SERIAL_EVENT_IDLE);
+  }
+}
+
+/**
+ * @brief Publish whatever the RX DMA wrote since the last call to the RX ring
+ *
+ * Called from the RX stream and the USART interrupts, which share a priority
+ * so only one of them is ever in here.
+ */
+static void PublishRxDma(UsartContext_TypeDef *ctx) {
+  uint32_t size = ctx->RxFifo.MaxSize;
+  uint32_t index = size - ctx->Descriptor->RxStream->NDTR;
+
+  if (index >= size) {
+    index = 0;
+  }
+
+  uint32_t count = (index >= ctx->RxDmaIndex) ? index - ctx->RxDmaIndex : index + size - ctx->RxDmaIndex;
+
+  if (count == 0) {
+    return;
+  }
+
+  uint32_t dropped = FIFO_Dropped(&ctx->RxFifo);
+  uint_fast8_t delimiter = (ctx->Events & SERIAL_EVENT_DELIMITER) && RxHasDelimiter(ctx, ctx->RxDmaIndex, count);
+  FIFOBroadcastContext_TypeDef *broadcast = ctx->RxBroadcast;
+
+  // the new bytes are still in the ring whatever the readers do, copy them
+  // out in at most two runs
+  if (broadcast) {
+    const uint8_t *buffer = ctx->RxFifo.Buffer;
+    uint32_t first = size - ctx->RxDmaIndex;
+
+    if (first > count) {
+      first = count;
+    }
+
+    FIFO_Broadcast_Write(broadcast, buffer + ctx->RxDmaIndex, first);
+    FIFO_Broadcast_Write(broadcast, buffer, count - first);
+  }
+
+  // the DMA doesn't wait for the main loop, the ring runs overwrite-oldest
+  // so a lap over unread bytes drops them instead of wedging the ring
+  FIFO_CommitWrite(&ctx->RxFifo, count);
+  ctx->RxDmaIndex = index;
+  RxFlowProduced(ctx);
+
+  // what's left now starts right after the lost bytes
+  if (FIFO_Dropped(&ctx->RxFifo) != dropped) {
+    MarkRxGap(ctx, ctx->RxFifo.ReadPos, SERIAL_BUFFER_FULL);
+  }
+
+  RaiseRxEvents(ctx, count, delimiter);
+}
+
+static uint32_t TakeRxByte(UsartContext_TypeDef *ctx);
+
+/**
+ * @brief Readers first take what DR holds while SERIAL_RX_HYBRID polls
+ *
+ * Unlike Usart_PollRx this does not ask for polling, a reader that sleeps
+ * between calls must keep the port on interrupts.
+ */
+static inline void RxPoll(UsartContext_TypeDef *ctx) {
+  if (ctx->RxPolling) {
+    TakeRxByte(ctx);
+  }
+}
+
+/**
+ * @brief Store a byte read from DR in SERIAL_RX_INTERRUPT and SERIAL_RX_HYBRID mode
+ * @param sr status register as read before DR
+ *
+ * From the USART ISR, or from Usart_PollRx while SERIAL_RX_HYBRID polls.
+ */
+static void ReceiveByte(UsartContext_TypeDef *ctx, uint32_t sr, uint8_t data) {
+  // a byte with FE/PE/NE is likely junk, it is counted but not stored
+  if ((sr & USART_SR_RXNE) && !(sr & (USART_SR_FE | USART_SR_PE | USART_SR_LBD | USART_SR_NE)) &&
+      !(ctx->FlowControl >= SERIAL_FLOW_XON_XOFF && RxSoftwareFlow(ctx, &data))) {
+    FIFOBroadcastContext_TypeDef *broadcast = ctx->RxBroadcast;
+
+    // broadcast readers keep their own pace, a full RX ring doesn't stop them
+    if (broadcast) {
+      FIFO_Broadcast_Write(broadcast, &data, 1);
+    }
+
+    if (FIFO_WriteByte(&ctx->RxFifo, data)) {
+      ctx->LastError = SERIAL_BUFFER_FULL;
+      MarkRxGap(ctx, ctx->RxFifo.WritePos, SERIAL_BUFFER_FULL);
+    }
+    else {
+      RaiseRxEvents(ctx, 1, (ctx->Events & SERIAL_EVENT_DELIMITER) && data == ctx->EventDelimiter);
+    }
+
+    RxFlowProduced(ctx);
+  }
+
+  // only enabled in DMA-less modes for SERIAL_EVENT_IDLE
+  if (sr & USART_SR_IDLE) {
+    RaiseRxIdle(ctx);
+  }
+
+  // the byte in DR on an overrun is good, the loss is right after it
+  if (sr & USART_SR_ORE) {
+    MarkRxGap(ctx, ctx->RxFifo.WritePos, SERIAL_OVER_RUN);
+  }
+}
+
+/**
+ * @brief Go back from polling to RXNE interrupts, USART ISR or Usart_PollRx with interrupts off
+ */
+static void StopRxPolling(UsartContext_TypeDef *ctx) {
+  ctx->RxPolling = FALSE;
+  ctx->Descriptor->Usart->CR1 |= USART_CR1_RXNEIE | ((ctx->Events & SERIAL_EVENT_IDLE) ? USART_CR1_IDLEIE : 0);
+}
+
+/**
+ * @brief Set up the TX DMA stream, transfers are started by StartTxDma
+ */
+static void InitTxDma(UsartContext_TypeDef *ctx) {
+  const UsartDescriptor_TypeDef *port = ctx->Descriptor;
+  DMA_Stream_TypeDef *stream = port->TxStream;
+
+  RCC->AHB1ENR |= port->DmaClockMask;
+
+  stream->CR &= ~DMA_SxCR_EN;
+  while (stream->CR & DMA_SxCR_EN);
+
+  DmaClearFlags(port->Dma, port->TxStreamIndex);
+
+  stream->PAR = (uint32_t)(uintptr_t)&port->Usart->DR;
+  stream->FCR = 0; // direct mode
+  stream->CR = port->DmaChannel | DMA_SxCR_DIR_0 | DMA_SxCR_MINC | DMA_SxCR_TCIE | DMA_SxCR_TEIE;
+
+  ctx->TxDmaLength = 0;
+  port->Usart->CR3 |= USART_CR3_DMAT;
+}
+
+/**
+ * @brief Send the next contiguous run of the TX ring, TX stream ISR only
+ *
+ * NDTR is 16 bits, a longer run goes out as several transfers since the TC
+ * handler only consumes TxDmaLength and comes back for the rest. When the
+ * ring is drained the USART TC interrupt is armed instead, it fires once the
+ * last byte has left the shift register.
+ */
+static void StartTxDma(UsartContext_TypeDef *ctx) {
+  const uint8_t *data;
+  uint32_t length = FIFO_MPSC_PeekContiguous(&ctx->TxFifo, &data);
+
+  if (length == 0) {
+    ctx->Descriptor->Usart->CR1 |= USART_CR1_TCIE;
+    return;
+  }
+
+  if (length > 0xFFFF) {
+    length = 0xFFFF;
+  }
+
+  ctx->TxDmaLength = length;
+
+  ctx->Descriptor->TxStream->M0AR = (uint32_t)(uintptr_t)data;
+  ctx->Descriptor->TxStream->NDTR = length;
+  ctx->Descriptor->TxStream->CR |= DMA_SxCR_EN;
+}
+
+/**
+ * @brief Feed the next byte to DR, USART ISR only in SERIAL_TX_INTERRUPT mode
+ * @param sr status register as read on ISR entry
+ *
+ * TXE stays enabled while there are bytes to send. Once nothing is ready TXE
+ * is switched off and TC armed to signal the end of transmission.
+ */
+static void TxInterrupt(UsartContext_TypeDef *ctx, uint32_t sr) {
+  USART_TypeDef *usart = ctx->Descriptor->Usart;
+  uint8_t byte;
+
+  // DR is still full, come back when it empties
+  if (!(sr & USART_SR_TXE)) {
+    usart->CR1 |= USART_CR1_TXEIE;
+    return;
+  }
+
+  // XON/XOFF go out even while the other end holds us off
+  if (ctx->TxControl) {
+    usart->DR = ctx->TxControl;
+    ctx->TxControl = 0;
+    usart->CR1 |= USART_CR1_TXEIE;
+    return;
+  }
+
+  // XON wakes us again
+  if (ctx->TxPaused) {
+    usart->CR1 &= ~USART_CR1_TXEIE;
+    return;
+  }
+
+  if (ctx->TxEscaped) {
+    usart->DR = ctx->TxEscaped;
+    ctx->TxEscaped = 0;
+    usart->CR1 |= USART_CR1_TXEIE;
+    return;
+  }
+
+  if (FIFO_MPSC_ReadN(&ctx->TxFifo, &byte, 1)) {
+    if (ctx->FlowControl == SERIAL_FLOW_XON_XOFF_BINARY &&
+        (byte == SERIAL_XON || byte == SERIAL_XOFF || byte == SERIAL_ESCAPE)) {
+      ctx->TxEscaped = byte ^ 0x20;
+      byte = SERIAL_ESCAPE;
+    }
+
+    usart->DR = byte;
+    usart->CR1 |= USART_CR1_TXEIE;
+    return;
+  }
+
+  // empty, or a sender we preempted is mid write and will kick again, either
+  // way leaving TXE enabled would just spin in here
+  usart->CR1 &= ~USART_CR1_TXEIE;
+  usart->CR1 |= USART_CR1_TCIE;
+}
+
+/**
+ * @brief Have the TX ISR pick up newly queued bytes
+ *
+ * The ISR is the ring's only consumer, senders never touch the stream or
+ * the TXE enable themselves.
+ */
+static void KickTx(UsartContext_TypeDef *ctx) {
+  if (ctx->TxMode == SERIAL_TX_DMA) {
+    NVIC_SetPendingIRQ(ctx->Descriptor->TxStreamIrq);
+  }
+  else {
+    ctx->TxKick = TRUE;
+    NVIC_SetPendingIRQ(ctx->Descriptor->Irq);
+  }
+}
+
+/**
+ * @brief Queue bytes on the TX ring and kick the TX ISR
+ *
+ * In thread mode it waits when the ring has no room for the next chunk, the
+ * TX ISR drains it meanwhile. From an interrupt handler it never waits: the
+ * TX ISRs can't preempt the caller when they run at the same or a lower
+ * priority, so waiting could lock up for good. What fits is queued and the
+ * rest is refused.
+ *
+ * @return
+ * SERIAL_SUCCESS -> bytes queued\n
+ * SERIAL_BUFFER_FULL -> another producer took the room first, or called from
+ * an interrupt handler with the ring full, the rest is not queued
+ */
+static SerialResult_t QueueTx(UsartContext_TypeDef *ctx, const uint8_t *source, uint32_t length) {
+  uint32_t size = ctx->TxFifo.MaxSize;
+  uint_fast8_t handler = (__get_IPSR() != 0);
+
+  while (length) {
+    uint32_t chunk = (length < size) ? length : size;
+
+    if (handler) {
+      uint32_t space = size - FIFO_MPSC_Count(&ctx->TxFifo);
+
+      if (space == 0) {
+        return SERIAL_BUFFER_FULL;
+      }
+
+      if (chunk > space) {
+        chunk = space;
+      }
+    }
+    else {
+      while (size - FIFO_MPSC_Count(&ctx->TxFifo) < chunk);
+    }
+
+    if (FIFO_MPSC_Write(&ctx->TxFifo, source, chunk)) {
+      return SERIAL_BUFFER_FULL;
+    }
+
+    KickTx(ctx);
+
+    source += chunk;
+    length -= chunk;
+  }
+
+  return SERIAL_SUCCESS;
+}
+
+/**
+ * @brief Last queued byte is out on the line, from the USART TC interrupt
+ */
+static void TxComplete(UsartContext_TypeDef *ctx) {
+  ctx->Descriptor->Usart->CR1 &= ~USART_CR1_TCIE;
+
+  // something was queued after TC was armed, the TX ISR will arm it again
+  if (ctx->TxDmaLength || FIFO_MPSC_Count(&ctx->TxFifo) || ctx->TxEscaped) {
+    return;
+  }
+
+  if (ctx->TxCallback) {
+    ctx->TxCallback();
+  }
+}
+
+/**
+ * @brief Work out BRR and oversampling for a baudrate
+ * @param pclk clock of the peripheral in Hz
+ * @param baudrate desired baudrate
+ * @param tolerancePpm largest error accepted, in parts per million
+ * @param[out] plan receives the register settings and the baudrate they give
+ *
+ * Both oversampling modes are tried. They divide PCLK in the same steps of
+ * one clock per bit, OVER8 just reaches up to PCLK / 8 where OVER16 stops at
+ * PCLK / 16. The lowest error wins, on a tie OVER16 is kept for its better
+ * noise and clock deviation tolerance.
+ *
+ * @return
+ * 0  -> plan filled in\n
+ * -1 -> no setting is within tolerancePpm of baudrate, plan is untouched
+ */
+int_fast8_t Usart_PlanBaud(uint32_t pclk, uint32_t baudrate, uint32_t tolerancePpm, UsartBaudPlan_TypeDef *plan) {
+  static const uint8_t oversampling[2] = { 16, 8 };
+  uint_fast8_t found = FALSE;
+
+  if (!baudrate || !plan) {
+    return -1;
+  }
+
+  // clocks per bit, which is USARTDIV in 1/16ths or 1/8ths of the mode
+  uint32_t clocks = (uint32_t)(((uint64_t)pclk + baudrate / 2) / baudrate);
+
+  for (uint32_t i = 0; i < sizeof(oversampling); i++) {
+    uint32_t samples = oversampling[i];
+    uint32_t fractionBits = (samples == 16) ? 4 : 3;
+
+    // USARTDIV needs a mantissa of 1 to 4095
+    if (clocks < samples || (clocks >> fractionBits) > 0xFFF) {
+      continue;
+    }
+
+    uint32_t achieved = (pclk + clocks / 2) / clocks;
+    uint32_t difference = (achieved > baudrate) ? achieved - baudrate : baudrate - achieved;
+    uint32_t errorPpm = (uint32_t)(((uint64_t)difference * 1000000U) / baudrate);
+
+    if (errorPpm > tolerancePpm || (found && errorPpm >= plan->ErrorPpm)) {
+      continue;
+    }
+
+    // OVER8 keeps its 3 fraction bits in BRR[2:0], BRR[3] must stay clear
+    plan->Brr = ((clocks >> fractionBits) << 4) | (clocks & (samples - 1));
+    plan->Over8 = (samples == 8);
+    plan->Baudrate = achieved;
+    plan->ErrorPpm = errorPpm;
+    found = TRUE;
+  }
+
+  return found ? 0 : -1;
+}
+
+/**
+ * @brief Rates a measured sync character is snapped to, slowest first
+ */
+static const uint32_t StandardBaudrates[] = {
+  1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200, 230400, 460800,
+  921600, 1000000, 1500000, 2000000, 3000000, 4000000
+};
+
+#define AUTOBAUD_SNAP_PPM 30000 // a measurement this close to a standard rate is taken as that rate
+#define AUTOBAUD_MAX_EDGES 10   // 0x55 toggles the line at every bit boundary
+
+/**
+ * @brief Work out the baudrate from the edges of a 0x55 or 0x7F sync character
+ * @param edges time of each line edge, edges[0] being the start bit's falling edge
+ * @param count number of edges
+ * @param clock rate the edge times count at in Hz
+ * @param[out] baudrate measured rate, snapped to a standard rate when one is close
+ *
+ * Both characters put their last edge, the rise into the stop bit, 9 bits
+ * after the start bit falls. Timing the whole character instead of one bit
+ * divides the capture jitter by 9. Every other edge has to land on the bit
+ * boundary the character puts it on, 0 to 9 for 0x55 and 0, 1, 8, 9 for
+ * 0x7F.
+ *
+ * @return
+ * 0  -> baudrate measured\n
+ * -1 -> edges don't look like 0x55 or 0x7F
+ */
+int_fast8_t Usart_BaudFromEdges(const uint32_t *edges, uint32_t count, uint32_t clock, uint32_t *baudrate) {
+  static const uint8_t sync7F[4] = { 0, 1, 8, 9 };
+
+  if (!edges || !baudrate || (count != 4 && count != AUTOBAUD_MAX_EDGES)) {
+    return -1;
+  }
+
+  uint32_t span = edges[count - 1] - edges[0];
+
+  if (span < 9) {
+    return -1;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t boundary = (count == 4) ? sync7F[i] : i;
+
+    // edge time in ninths of a bit against the boundary, a quarter bit off is too far
+    uint64_t at = (uint64_t)(edges[i] - edges[0]) * 9;
+    uint64_t expected = (uint64_t)boundary * span;
+    uint64_t deviation = (at > expected) ? at - expected : expected - at;
+
+    if (deviation * 4 > span) {
+      return -1;
+    }
+  }
+
+  uint32_t measured = (uint32_t)(((uint64_t)clock * 9 + span / 2) / span);
+  uint32_t best = measured;
+  uint32_t bestPpm = AUTOBAUD_SNAP_PPM;
+
+  for (uint32_t i = 0; i < sizeof(StandardBaudrates) / sizeof(StandardBaudrates[0]); i++) {
+    uint32_t rate = StandardBaudrates[i];
+    uint32_t difference = (measured > rate) ? measured - rate : rate - measured;
+    uint32_t ppm = (uint32_t)(((uint64_t)difference * 1000000U) / rate);
+
+    if (ppm <= bestPpm) {
+      best = rate;
+      bestPpm = ppm;
+    }
+  }
+
+  *baudrate = best;
+
+  return 0;
+}
+
+/**
+ * @brief Measure the host's baudrate from a sync character, port must be closed
+ * @param timeoutMs how long to wait for the character to start
+ * @param[out] baudrate measured rate, pass it to Open in SerialConfig_TypeDef
+ *
+ * The RX pin is switched to a plain input and polled against the DWT cycle
+ * counter, the USART3 RX pin PD9 has no timer channel to capture with.
+ * Interrupts are masked from the start bit until half way into the stop bit,
+ * 9.5 bits, so the samples aren't delayed and a character sent straight after
+ * isn't mistaken for part of this one. The sync character itself is
+ * not received, Open puts the pin back on the USART.
+ *
+ * @return
+ * SERIAL_SUCCESS -> baudrate measured\n
+ * SERIAL_FAIL -> port is open\n
+ * SERIAL_INVALID_PARAMETER -> baudrate is a null pointer\n
+ * SERIAL_NO_DATA -> no character started within timeoutMs\n
+ * SERIAL_FRAMING_ERROR -> the character was not 0x55 or 0x7F, or was caught halfway
+ */
+SerialResult_t Usart_DetectBaudrate(UsartContext_TypeDef *ctx, uint32_t timeoutMs, uint32_t *baudrate) {
+  const UsartDescriptor_TypeDef *port = ctx->Descriptor;
+  GPIO_TypeDef *rx = port->RxPort;
+  uint32_t pin = 1U << port->RxPin;
+  uint32_t edges[AUTOBAUD_MAX_EDGES];
+  uint32_t count = 1;
+
+  if (ctx->IsOpen) {
+    return SERIAL_FAIL;
+  }
+
+  if (!baudrate) {
+    return SERIAL_INVALID_PARAMETER;
+  }
+
+  RCC->AHB1ENR |= port->GpioClockMask;
+  rx->MODER &= ~(3U << (port->RxPin * 2));        // input
+  rx->PUPDR &= ~(3U << (port->RxPin * 2));
+  rx->PUPDR |= 1U << (port->RxPin * 2);           // pull up, an unplugged line reads idle
+
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  SystemCoreClockUpdate();
+
+  // longest start bit there is, anything longer is a break or a dead line
+  uint32_t longestBit = SystemCoreClock / StandardBaudrates[0] * 2;
+  uint32_t start = Tick_GetMs();
+
+  // get onto idle, then catch the start bit's falling edge
+  while (!(rx->IDR & pin)) {
+    if (Tick_GetMs() - start >= timeoutMs) {
+      return SERIAL_NO_DATA;
+    }
+  }
+
+  while (rx->IDR & pin) {
+    if (Tick_GetMs() - start >= timeoutMs) {
+      return SERIAL_NO_DATA;
+    }
+  }
+
+  edges[0] = DWT->CYCCNT;
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  uint32_t level = 0;
+  uint32_t end = longestBit;
+
+  for (;;) {
+    uint32_t now = DWT->CYCCNT;
+    uint32_t sample = (rx->IDR & pin) ? 1 : 0;
+
+    if (sample != level) {
+      if (count == AUTOBAUD_MAX_EDGES) {
+        count = 0;
+        break;
+      }
+
+      level = sample;
+      edges[count++] = now;
+
+      // the first bit tells how long the character lasts, the stop bit rises
+      // at 9 bits and a back to back character's start bit falls at 10, so
+      // stop half way in between
+      if (count == 2) {
+        end = ((now - edges[0]) * 19) / 2;
+      }
+    }
+
+    if (now - edges[0] > end) {
+      break;
+    }
+  }
+
+  __set_PRIMASK(primask);
+
+  if (Usart_BaudFromEdges(edges, count, SystemCoreClock, baudrate)) {
+    return SERIAL_FRAMING_ERROR;
+  }
+
+  return SERIAL_SUCCESS;
+}
+
+/**
+ * @brief Return the status of the Interface
+ *
+ * @return
+ * 1 -> Open\n
+ * 0 -> Closed
+ */
+uint_fast8_t Usart_IsOpen(UsartContext_TypeDef *ctx) {
+  return ctx->IsOpen;
+}
+
+/**
+ * @brief Closes open interface
+ */
+void Usart_Close(UsartContext_TypeDef *ctx) {
+  USART_TypeDef *usart = ctx->Descriptor->Usart;
+
+  usart->CR1 &= ~(USART_CR1_UE | USART_CR1_RXNEIE | USART_CR1_IDLEIE | USART_CR1_TXEIE | USART_CR1_TCIE);
+  DisableISR(ctx);
+  StopRxDma(ctx);
+  usart->CR3 &= ~(USART_CR3_DMAT | USART_CR3_EIE | USART_CR3_CTSE);
+  ctx->Descriptor->TxStream->CR &= ~DMA_SxCR_EN;
+
+  // nothing reads the ring any more, hold the other end off
+  if (ctx->FlowControl == SERIAL_FLOW_RTS_CTS) {
+    SetRts(ctx->Descriptor, FALSE);
+  }
+
+  ctx->IsOpen = FALSE;
+}
+
+/**
+ * @brief Checks if write is in progress
+ *
+ * @return
+ * 1 -> Write in progress\n
+ * 0 -> Interface ready
+ */
+static uint_fast8_t IsWriteBusy(UsartContext_TypeDef *ctx) {
+  return !(ctx->Descriptor->Usart->SR & USART_SR_TXE);
+}
+
+/**
+ * @brief Checks if there is data to read
+ *
+ * @return
+ * 1 -> Data to read\n
+ * 0 -> No data to read
+ */
+uint_fast8_t Usart_RxBufferHasData(UsartContext_TypeDef *ctx) {
+  RxPoll(ctx);
+  return FIFO_Count(&ctx->RxFifo) != 0;
+}
+
+/**
+ * @brief Checks if queued bytes are still going out
+ *
+ * @return
+ * 1 -> Bytes queued or still shifting out\n
+ * 0 -> Everything sent has left the line
+ */
+uint_fast8_t Usart_IsTxBusy(UsartContext_TypeDef *ctx) {
+  USART_TypeDef *usart = ctx->Descriptor->Usart;
+
+  if (ctx->TxMode != SERIAL_TX_BLOCKING) {
+    return FIFO_MPSC_Count(&ctx->TxFifo) || ctx->TxEscaped || (usart->CR1 & USART_CR1_TCIE);
+  }
+
+  return !(usart->SR & USART_SR_TC);
+}
+
+/**
+ * @brief Register a callback for when everything queued has been sent
+ * @param onComplete called from the USART ISR, NULL to remove it
+ *
+ * Only called in SERIAL_TX_DMA and SERIAL_TX_INTERRUPT mode, where the send
+ * functions return before the bytes are out.
+ */
+void Usart_SetTxCallback(UsartContext_TypeDef *ctx, void (*onComplete)(void)) {
+  ctx->TxCallback = onComplete;
+}
+
+/**
+ * @brief Also write every received byte to a broadcast ring
+ * @param broadcast ring for the extra readers, NULL to stop
+ *
+ * The bytes still go to the RX ring for GetByte and the other readers. The
+ * broadcast ring is written from the same interrupts that fill the RX ring
+ * and overwrites its oldest bytes, a reader that falls behind sees it in
+ * FIFO_Broadcast_CheckOverrun. Attach readers with
+ * FIFO_Broadcast_ReaderInit after this, they start from the next byte.
+ */
+void Usart_SetRxBroadcast(UsartContext_TypeDef *ctx, FIFOBroadcastContext_TypeDef *broadcast) {
+  ctx->RxBroadcast = broadcast;
+}
+
+/**
+ * @brief Baudrate the port actually runs at, BRR rounding included
+ *
+ * @return baudrate, 0 when closed
+ */
+uint32_t Usart_GetBaudrate(UsartContext_TypeDef *ctx) {
+  return ctx->IsOpen ? ctx->Baudrate : 0;
+}
+
+/**
+ * @brief Wake the application on receive events instead of having it poll
+ * @param config events to raise and the callback, NULL to stop
+ *
+ * Can be called open or closed. IdleUs is turned into DWT cycles at the
+ * current SystemCoreClock, so up to about 23 s at 180 MHz.
+ *
+ * @return
+ * SERIAL_SUCCESS -> events set\n
+ * SERIAL_INVALID_PARAMETER -> no OnEvent, or SERIAL_EVENT_COUNT with a zero Threshold, no events are raised
+ */
+SerialResult_t Usart_SetEventCallback(UsartContext_TypeDef *ctx, const SerialEventConfig_TypeDef *config) {
+  SerialResult_t result = SERIAL_SUCCESS;
+
+  // the ISR stops looking before the rest changes
+  ctx->Events = 0;
+  FIFO_Barrier();
+
+  if (config && config->Events) {
+    if (!config->OnEvent || ((config->Events & SERIAL_EVENT_COUNT) && config->Threshold == 0)) {
+      result = SERIAL_INVALID_PARAMETER;
+    }
+    else {
+      if (config->Events & SERIAL_EVENT_IDLE) {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+        SystemCoreClockUpdate();
+        ctx->EventIdleCycles = config->IdleUs * (SystemCoreClock / 1000000U);
+      }
+
+      ctx->EventThreshold = config->Threshold;
+      ctx->EventDelimiter = config->Delimiter;
+      ctx->OnEvent = config->OnEvent;
+      ctx->RxIdleArmed = FALSE;
+      ctx->IdleKick = FALSE;
+
+      FIFO_Barrier();
+      ctx->Events = config->Events;
+    }
+  }
+
+  // DMA mode always has IDLEIE on, the others only need it for the idle
+  // event and not while polling, CR1 is shared with the ISR so hold it off
+  if (ctx->IsOpen && ctx->RxMode != SERIAL_RX_DMA) {
+    USART_TypeDef *usart = ctx->Descriptor->Usart;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    if ((ctx->Events & SERIAL_EVENT_IDLE) && !ctx->RxPolling) {
+      usart->CR1 |= USART_CR1_IDLEIE;
+    }
+    else {
+      usart->CR1 &= ~USART_CR1_IDLEIE;
+    }
+
+    __set_PRIMASK(primask);
+  }
+
+  return result;
+}
+
+/**
+ * @brief Time out SERIAL_EVENT_IDLE and end SERIAL_RX_HYBRID polling, from SysTick
+ *
+ * The line idle interrupt only covers one character time, longer quiet
+ * times are caught here at the tick rate. The event itself is raised from
+ * the USART ISR, so OnEvent never runs from two interrupts at once.
+ */
+void Usart_Tick(UsartContext_TypeDef *ctx) {
+  if (!ctx->IsOpen) {
+    return;
+  }
+
+  // traffic calmed down or the application stopped polling, the ISR
+  // switches back as only it may touch CR1
+  if (ctx->RxMode == SERIAL_RX_HYBRID) {
+    uint32_t bytes = ctx->RxTickBytes;
+    uint_fast8_t wanted = ctx->RxPollWanted;
+
+    ctx->RxTickBytes = 0;
+    ctx->RxPollWanted = FALSE;
+
+    if (ctx->RxPolling && (bytes < USART_RX_HYBRID_QUIET || !wanted)) {
+      ctx->RxPollExit = TRUE;
+      NVIC_SetPendingIRQ(ctx->Descriptor->Irq);
+    }
+  }
+
+  if (!(ctx->Events & SERIAL_EVENT_IDLE) || !ctx->RxIdleArmed) {
+    return;
+  }
+
+  if (DWT->CYCCNT - ctx->RxLastCycles >= ctx->EventIdleCycles) {
+    ctx->IdleKick = TRUE;
+    NVIC_SetPendingIRQ(ctx->Descriptor->Irq);
+  }
+}
+
+/**
+ * @brief Last receive status seen by the ISR, or SERIAL_DMA_ERROR after a failed TX DMA transfer
+ */
+SerialResult_t Usart_GetLastError(UsartContext_TypeDef *ctx) {
+  return ctx->LastError;
+}
+
+/**
+ * @brief Get the receive error counters
+ * @param[out] stats receives the counters
+ *
+ * @return
+ * SERIAL_SUCCESS -> stats filled in\n
+ * SERIAL_INVALID_PARAMETER -> stats is a null pointer
+ */
+SerialResult_t Usart_GetErrorStats(UsartContext_TypeDef *ctx, SerialErrorStats_TypeDef *stats) {
+  if (!stats) {
+    return SERIAL_INVALID_PARAMETER;
+  }
+
+  *stats = ctx->Errors;
+
+  return SERIAL_SUCCESS;
+}
+
+/**
+ * @brief Open serial interface with specified settings
+ * @param config baudrate, receive and transmit modes and ring storage
+ *
+ * @return
+ * SERIAL_FAIL    -> interface is open, nothing to do\n
+ * SERIAL_INVALID_PARAMETER -> config is a null pointer, its ring storage is missing, TxSize is not a power of two,
+ * RxSize is over 0xFFFF in SERIAL_RX_DMA mode (NDTR is 16 bits), flow control watermarks are outside
+ * 0 < low < high <= RxSize, RTS/CTS was asked for on a port without the lines or XON/XOFF without
+ * SERIAL_RX_INTERRUPT and SERIAL_TX_INTERRUPT\n
+ * SERIAL_BAUD_UNREACHABLE -> the peripheral clock can't make Baudrate within USART_BAUD_TOLERANCE_PPM\n
+ * SERIAL_SUCCESS -> interface was opened and initialized
+ */
+SerialResult_t Usart_Open(UsartContext_TypeDef *ctx, const SerialConfig_TypeDef *config) {
+  const UsartDescriptor_TypeDef *port = ctx->Descriptor;
+  USART_TypeDef *usart = port->Usart;
+
+  if (ctx->IsOpen) {
+    return SERIAL_FAIL;
+  }
+
+  if (!config) {
+    return SERIAL_INVALID_PARAMETER;
+  }
+
+  // circular DMA covers the whole ring in one transfer and NDTR is 16 bits
+  if (config->RxMode == SERIAL_RX_DMA && config->RxSize > 0xFFFF) {
+    return SERIAL_INVALID_PARAMETER;
+  }
+
+  if (FIFO_Init(&ctx->RxFifo, config->RxSize, sizeof(uint8_t), config->RxBuffer)) {
+    return SERIAL_INVALID_PARAMETER;
+  }
+
+  // ready flags go after the bytes, see SERIAL_TX_STORAGE_SIZE
+  if (config->TxMode != SERIAL_TX_BLOCKING &&
+      (!config->TxBuffer || FIFO_MPSC_Init(&ctx->TxFifo, config->TxSize, config->TxBuffer, config->TxBuffer + config->TxSize))) {
+    return SERIAL_INVALID_PARAMETER;
+  }
+
+  uint32_t high = config->RxHighWatermark ? config->RxHighWatermark : config->RxSize / 2;
+  uint32_t low = config->RxLowWatermark ? config->RxLowWatermark : config->RxSize / 4;
+
+  if (config->FlowControl != SERIAL_FLOW_NONE && (low == 0 || low >= high || high > config->RxSize)) {
+    return SERIAL_INVALID_PARAMETER;
+  }
+
+  if (config->FlowControl == SERIAL_FLOW_RTS_CTS && !port->RtsPort) {
+    return SERIAL_INVALID_PARAMETER;
+  }
+
+  // XON/XOFF has to see every byte and own DR, both only the USART ISR does
+  if (config->FlowControl >= SERIAL_FLOW_XON_XOFF &&
+      (config->RxMode != SERIAL_RX_INTERRUPT || config->TxMode != SERIAL_TX_INTERRUPT)) {
+    return SERIAL_INVALID_PARAMETER;
+  }
+
+  UsartBaudPlan_TypeDef plan;
+
+  if (Usart_PlanBaud(GetPclk(port), config->Baudrate, USART_BAUD_TOLERANCE_PPM, &plan)) {
+    return SERIAL_BAUD_UNREACHABLE;
+  }
+
+  ctx->Baudrate = plan.Baudrate;
+  ctx->RxMode = config->RxMode;
+  ctx->TxMode = config->TxMode;
+  ctx->FlowControl = config->FlowControl;
+  ctx->RxHighWatermark = high;
+  ctx->RxLowWatermark = low;
+  ctx->RxPaused = FALSE;
+  ctx->RxEscape = FALSE;
+  ctx->TxControl = 0;
+  ctx->TxEscaped = 0;
+  ctx->TxPaused = FALSE;
+  ctx->RxPolling = FALSE;
+  ctx->RxPollExit = FALSE;
+  ctx->RxTickBytes = 0;
+  ctx->RxPollWanted = FALSE;
+  ctx->TxKick = FALSE;
+  ctx->LastError = SERIAL_SUCCESS;
+  memset(&ctx->Errors, 0, sizeof(ctx->Errors));
+  ctx->RxGapsMarked = 0;
+  ctx->RxGapsSeen = 0;
+  ctx->RxPeekPos = 0;
+
+  // a per byte ISR can refuse a byte, circular DMA can't
+  if (ctx->RxMode == SERIAL_RX_DMA) {
+    FIFO_SetOverflowPolicy(&ctx->RxFifo, FIFO_OVERFLOW_OVERWRITE_OLDEST, NULL);
+  }
+
+  RCC->AHB1ENR |= port->GpioClockMask;
+  SetAlternateFunction(port->TxPort, port->TxPin, port->AlternateFunction);
+  SetAlternateFunction(port->RxPort, port->RxPin, port->AlternateFunction);
+
+  *port->ClockRegister |= port->ClockMask;
+  usart->CR1 = 0;
+  usart->CR1 &= ~USART_CR1_M;    // 8 bit data
+  usart->CR2 &= ~USART_CR2_STOP; // 1 stop bit
+
+  if (plan.Over8) {
+    usart->CR1 |= USART_CR1_OVER8;
+  }
+  else {
+    usart->CR1 &= ~USART_CR1_OVER8;
+  }
+
+  usart->BRR = plan.Brr;
+
+  if (ctx->FlowControl == SERIAL_FLOW_RTS_CTS) {
+    InitFlowControl(ctx);
+  }
+
+  if (ctx->RxMode == SERIAL_RX_DMA) {
+    StartRxDma(ctx);
+  }
+
+  if (ctx->TxMode == SERIAL_TX_DMA) {
+    InitTxDma(ctx);
+  }
+
+  usart->CR1 |= USART_CR1_UE | USART_CR1_TE | USART_CR1_RE;
+
+  EnableISR(ctx);
+
+  ctx->IsOpen = TRUE;
+  return SERIAL_SUCCESS;
+}
+
+/**
+ * @brief Send one byte over the interface
+ * @param source is the byte to send
+ *
+ * @return
+ * SERIAL_CLOSED -> Interface is closed and nothing is done\n
+ * SERIAL_BUFFER_FULL -> queued modes only, the TX ring was taken by another sender, or it
+ * was full and this was called from an interrupt handler, which queues what fits and never waits\n
+ * SERIAL_SUCCESS -> Byte has been sent (queued in the DMA and interrupt modes)
+ */
+SerialResult_t Usart_SendByte(UsartContext_TypeDef *ctx, uint8_t source) {
+  if (!ctx->IsOpen) {
+    return SERIAL_CLOSED;
+  }
+
+  if (ctx->TxMode != SERIAL_TX_BLOCKING) {
+    return QueueTx(ctx, &source, 1);
+  }
+
+  while (IsWriteBusy(ctx));
+
+  ctx->Descriptor->Usart->DR = source;
+
+  return SERIAL_SUCCESS;
+}
+
+/**
+ * @brief USART interrupt, receive, TX interrupt mode and end of transmission
+ *
+ * Counts every error flag in Errors and records the receive status in
+ * LastError:\n
+ * SERIAL_SUCCESS -> Byte successfully read without errors\n
+ * SERIAL_OVER_RUN -> Byte in data register is valid, but next byte to be shifted in is being overwritten (I.E not reading fast enough)\n
+ * SERIAL_FRAMING_ERROR -> Byte in data register is likely junk and issue with buadrate or other parameters thus interface is no longer in sync\n
+ * SERIAL_PARITY_ERROR -> Byte in data register is likely junk and parity check failed\n
+ * SERIAL_NOISE_ERROR -> Byte is data register is likely junk and noise was detected on the line\n
+ * SERIAL_BUFFER_FULL -> RX ring was full and the byte was dropped
+ *
+ * Overruns and dropped bytes also leave a loss marker in the RX ring.
+ */
+void Usart_IRQHandler(UsartContext_TypeDef *ctx) {
+  USART_TypeDef *usart = ctx->Descriptor->Usart;
+  uint32_t sr = usart->SR;
+
+  if ((usart->CR1 & USART_CR1_TCIE) && (sr & USART_SR_TC)) {
+    TxComplete(ctx);
+  }
+
+  if (ctx->TxMode == SERIAL_TX_INTERRUPT && (ctx->TxKick || ((usart->CR1 & USART_CR1_TXEIE) && (sr & USART_SR_TXE)))) {
+    ctx->TxKick = FALSE;
+    TxInterrupt(ctx, sr);
+  }
+
+  if (ctx->IdleKick) {
+    ctx->IdleKick = FALSE;
+    RaiseRxIdle(ctx);
+  }
+
+  if (ctx->RxPollExit) {
+    ctx->RxPollExit = FALSE;
+    StopRxPolling(ctx);
+  }
+
+  // the readers own DR while polling
+  if (ctx->RxPolling) {
+    return;
+  }
+
+  // a TX only interrupt must not read DR, that would swallow a byte
+  if (!(sr & (USART_SR_RXNE | USART_SR_IDLE | USART_SR_ORE | USART_SR_NE | USART_SR_FE | USART_SR_PE))) {
+    return;
+  }
+
+  uint8_t data = usart->DR;
+
+  CountRxErrors(ctx, sr);
+
+  // in DMA mode we only get here on idle line or an error, reading SR then
+  // DR above already cleared the flag
+  if (ctx->RxMode == SERIAL_RX_DMA) {
+    PublishRxDma(ctx);
+
+    if (sr & USART_SR_ORE) {
+      MarkRxGap(ctx, ctx->RxFifo.WritePos, SERIAL_OVER_RUN);
+    }
+
+    if (sr & USART_SR_IDLE) {
+      RaiseRxIdle(ctx);
+    }
+    return;
+  }
+
+  ReceiveByte(ctx, sr, data);
+
+  // a burst, stop paying an interrupt per byte and let the readers poll,
+  // but only if the application is there to do it
+  if (ctx->RxMode == SERIAL_RX_HYBRID && (sr & USART_SR_RXNE) && ++ctx->RxTickBytes >= USART_RX_HYBRID_BURST &&
+      ctx->RxPollWanted) {
+    ctx->RxPolling = TRUE;
+    usart->CR1 &= ~(USART_CR1_RXNEIE | USART_CR1_IDLEIE);
+  }
+}
+
+/**
+ * @brief RX DMA half transfer and transfer complete
+ *
+ * Publishes the bytes received so far, so a continuous stream is handed to
+ * the main loop at least twice per lap of the ring.
+ */
+void Usart_RxDmaIRQHandler(UsartContext_TypeDef *ctx) {
+  DmaClearFlags(ctx->Descriptor->Dma, ctx->Descriptor->RxStreamIndex);
+  PublishRxDma(ctx);
+}
+
+/**
+ * @brief TX DMA transfer complete or error, or a kick from QueueTx
+ *
+ * Releases the bytes the finished transfer sent and starts the next one.
+ * A kick while a transfer is running does nothing, the transfer complete
+ * picks up whatever was queued meanwhile.
+ *
+ * A transfer error disables the stream without a transfer complete. Its
+ * bytes are dropped rather than sent again, a ring the DMA can't reach would
+ * fail the same way every time, and TX carries on with the next run.
+ */
+void Usart_TxDmaIRQHandler(UsartContext_TypeDef *ctx) {
+  const UsartDescriptor_TypeDef *port = ctx->Descriptor;
+  uint8_t index = port->TxStreamIndex;
+  uint32_t flags = *DmaStatus(port->Dma, index) >> DmaFlagShift[index & 3];
+
+  if (flags & (DMA_FLAG_TC | DMA_FLAG_TE)) {
+    if (flags & DMA_FLAG_TE) {
+      ctx->LastError = SERIAL_DMA_ERROR;
+    }
+
+    DmaClearFlags(port->Dma, index);
+    FIFO_MPSC_Consume(&ctx->TxFifo, ctx->TxDmaLength);
+    ctx->TxDmaLength = 0;
+  }
+
+  if (ctx->TxDmaLength == 0) {
+    StartTxDma(ctx);
+  }
+}
+
+/**
+ * @brief Opt in to SERIAL_RX_HYBRID polling and take what DR holds
+ *
+ * A burst only switches the port to polling while this is being called, a
+ * SysTick without a call switches it back. Call it from a loop that doesn't
+ * sleep, an application waiting on WFI or an event would leave DR unread and
+ * lose bytes. GetByte, PeekBytes, ReadUntil, PeekLine and RxBufferHasData
+ * also drain DR while polling but don't opt in. The USART has no receive
+ * FIFO, so polling only keeps up when the loop comes back within a byte
+ * time. An overrun while polling goes straight back to interrupts,
+ * otherwise the next SysTick with fewer than USART_RX_HYBRID_QUIET bytes
+ * does. Events are raised from here while polling. SerialPorts_Tick must be
+ * hooked to SysTick.
+ *
+ * @return number of bytes taken, 0 or 1, always 0 when not polling
+ */
+uint32_t Usart_PollRx(UsartContext_TypeDef *ctx) {
+  ctx->RxPollWanted = TRUE;
+
+  return TakeRxByte(ctx);
+}
+
+/**
+ * @brief Take what DR holds while SERIAL_RX_HYBRID polls, see Usart_PollRx
+ *
+ * @return number of bytes taken, 0 or 1, always 0 when not polling
+ */
+static uint32_t TakeRxByte(UsartContext_TypeDef *ctx) {
+  USART_TypeDef *usart = ctx->Descriptor->Usart;
+  uint32_t taken = 0;
+
+  // the ISR may switch back at any time, hold it off so DR has one owner
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  uint32_t sr = usart->SR;
+
+  // DR holds a single byte, the next one is a byte time away anyway
+  if (ctx->RxPolling && (sr & (USART_SR_RXNE | USART_SR_IDLE | USART_SR_ORE | USART_SR_NE | USART_SR_FE | USART_SR_PE))) {
+    uint8_t data = usart->DR;
+
+    CountRxErrors(ctx, sr);
+    ReceiveByte(ctx, sr, data);
+
+    if (sr & USART_SR_RXNE) {
+      ctx->RxTickBytes++;
+      taken++;
+    }
+
+    // not polling fast enough, interrupts at least don't miss the next one
+    if (sr & USART_SR_ORE) {
+      StopRxPolling(ctx);
+    }
+  }
+
+  __set_PRIMASK(primask);
+
+  return taken;
+}
+
+/**
+ * @brief Copy received bytes out of the RX ring
+ * @param[out] destination buffer for the bytes
+ * @param length size of destination
+ *
+ * @return
+ * >= 0 -> number of bytes copied, stops short of a loss marker\n
+ * SERIAL_OVER_RUN, SERIAL_BUFFER_FULL -> bytes were lost here, the next call reads on\n
+ * SERIAL_CLOSED -> Interface is closed and nothing is done\n
+ * SERIAL_INVALID_PARAMETER -> destination is a null pointer
+ */
+int32_t Usart_GetByte(UsartContext_TypeDef *ctx, uint8_t *destination, uint32_t length) {
+  if (!ctx->IsOpen) {
+    return SERIAL_CLOSED;
+  }
+
+  if (!destination) {
+    return SERIAL_INVALID_PARAMETER;
+  }
+
+  if (length == 0) {
+    return 0;
+  }
+
+  RxPoll(ctx);
+
+  int32_t limit = RxBeforeGap(ctx, length);
+
+  if (limit <= 0) {
+    return limit;
+  }
+
+  // The ISR only moves the write position and we only move the read position
+  // so there is no need to mask the interrupt while copying out.
+  uint32_t count = FIFO_ReadN(&ctx->RxFifo, destination, limit);
+
+  RxFlowConsumed(ctx);
+  return count;
+}
+
+/**
+ * @brief Copy one line out of the RX ring
+ * @param delimiter byte ending a line, e.g. '\r'
+ * @param[out] destination buffer for the line
+ * @param length size of destination
+ *
+ * The ring is searched in place and only the line itself is copied. A line
+ * that can't get any longer for us is returned without its delimiter: one
+ * that fills destination, fills the ring or runs into a loss marker.
+ *
+ * @return
+ * > 0 -> bytes copied, the delimiter included when it was found\n
+ * 0 -> no complete line yet, nothing is copied\n
+ * SERIAL_OVER_RUN, SERIAL_BUFFER_FULL -> bytes were lost here, the next call reads on\n
+ * SERIAL_CLOSED -> Interface is closed and nothing is done\n
+ * SERIAL_INVALID_PARAMETER -> destination is a null pointer
+ */
+int32_t Usart_ReadUntil(UsartContext_TypeDef *ctx, uint8_t delimiter, uint8_t *destination, uint32_t length) {
+  if (!ctx->IsOpen) {
+    return SERIAL_CLOSED;
+  }
+
+  if (!destination) {
+    return SERIAL_INVALID_PARAMETER;
+  }
+
+  if (length == 0) {
+    return 0;
+  }
+
+  RxPoll(ctx);
+
+  int32_t limit = RxBeforeGap(ctx, FIFO_Count(&ctx->RxFifo));
+
+  if (limit <= 0) {
+    return limit;
+  }
+
+  uint32_t window = ((uint32_t)limit < length) ? (uint32_t)limit : length;
+  uint32_t line = ScanLine(ctx, delimiter, window);
+
+  if (line == 0) {
+    if (window != length && window != ctx->RxFifo.MaxSize && ctx->RxGapsMarked == ctx->RxGapsSeen) {
+      return 0;
+    }
+
+    line = window;
+  }
+
+  uint32_t count = FIFO_ReadN(&ctx->RxFifo, destination, line);
+
+  RxFlowConsumed(ctx);
+  return count;
+}
+
+/**
+ * @brief Length of the next line in the RX ring, nothing is copied or released
+ * @param delimiter byte ending a line, e.g. '\r'
+ *
+ * Read the line with GetByte, or PeekBytes and ConsumeBytes to parse it in
+ * place. A line that can't get any longer, because it fills the ring or runs
+ * into a loss marker, is returned without its delimiter.
+ *
+ * @return
+ * > 0 -> bytes in the line, the delimiter included when it was found\n
+ * 0 -> no complete line yet\n
+ * SERIAL_OVER_RUN, SERIAL_BUFFER_FULL -> bytes were lost here, the next call reads on\n
+ * SERIAL_CLOSED -> Interface is closed and nothing is done
+ */
+int32_t Usart_PeekLine(UsartContext_TypeDef *ctx, uint8_t delimiter) {
+  if (!ctx->IsOpen) {
+    return SERIAL_CLOSED;
+  }
+
+  RxPoll(ctx);
+
+  int32_t limit = RxBeforeGap(ctx, FIFO_Count(&ctx->RxFifo));
+
+  if (limit <= 0) {
+    return limit;
+  }
+
+  uint32_t line = ScanLine(ctx, delimiter, limit);
+
+  if (line) {
+    return line;
+  }
+
+  if ((uint32_t)limit == ctx->RxFifo.MaxSize || ctx->RxGapsMarked != ctx->RxGapsSeen) {
+    return limit;
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Point at received bytes without copying them out
+ * @param[out] data set to the oldest received byte
+ *
+ * The bytes stay in the RX ring until Usart_ConsumeBytes is called, so they
+ * can be parsed or sent straight from the ring. Only the part up to the end
+ * of the ring is returned, call again after consuming to get the wrapped
+ * part.
+ *
+ * @return
+ * >= 0 -> number of bytes readable at data, stops short of a loss marker\n
+ * SERIAL_OVER_RUN, SERIAL_BUFFER_FULL -> bytes were lost here, the next call reads on\n
+ * SERIAL_CLOSED -> Interface is closed and nothing is done\n
+ * SERIAL_INVALID_PARAMETER -> data is a null pointer
+ */
+int32_t Usart_PeekBytes(UsartContext_TypeDef *ctx, const uint8_t **data) {
+  if (!ctx->IsOpen) {
+    return SERIAL_CLOSED;
+  }
+
+  if (!data) {
+    return SERIAL_INVALID_PARAMETER;
+  }
+
+  RxPoll(ctx);
+
+  ctx->RxPeekPos = ctx->RxFifo.ReadPos;
+
+  uint32_t length = FIFO_PeekContiguous(&ctx->RxFifo, (const void **)data);
+
+  return RxBeforeGap(ctx, length);
+}
+
+/**
+ * @brief Release bytes returned by Usart_PeekBytes back to the RX ring
+ * @param length number of bytes to release
+ *
+ * In SERIAL_RX_DMA the ring overwrites its oldest bytes when the reader falls
+ * a lap behind, so the DMA may have written over the peeked bytes before they
+ * were released. That is reported as SERIAL_OVER_RUN: what the caller read at
+ * data can't be trusted, the lost bytes are already in GetRxDropped and the
+ * next Usart_PeekBytes carries on with the oldest byte still in the ring.
+ *
+ * @return
+ * SERIAL_SUCCESS -> Bytes released\n
+ * SERIAL_OVER_RUN -> SERIAL_RX_DMA only, the peeked bytes were overwritten, nothing is released\n
+ * SERIAL_CLOSED -> Interface is closed and nothing is done\n
+ * SERIAL_INVALID_PARAMETER -> length is more than what was received
+ */
+SerialResult_t Usart_ConsumeBytes(UsartContext_TypeDef *ctx, uint32_t length) {
+  SerialResult_t result = SERIAL_SUCCESS;
+
+  if (!ctx->IsOpen) {
+    return SERIAL_CLOSED;
+  }
+
+  // an overwrite moves ReadPos on from where the peek was, the DMA ISR is
+  // held off so it can't get in between the check and the release
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  if (ctx->RxMode == SERIAL_RX_DMA && ctx->RxFifo.ReadPos != ctx->RxPeekPos) {
+    result = SERIAL_OVER_RUN;
+  }
+  else if (FIFO_Consume(&ctx->RxFifo, length)) {
+    result = SERIAL_INVALID_PARAMETER;
+  }
+
+  ctx->RxPeekPos = ctx->RxFifo.ReadPos;
+
+  __set_PRIMASK(primask);
+
+  if (result != SERIAL_SUCCESS) {
+    return result;
+  }
+
+  RxFlowConsumed(ctx);
+  return SERIAL_SUCCESS;
+}
+
+/**
+ * @brief Number of received bytes dropped because the RX ring was full
+ */
+uint32_t Usart_GetRxDropped(UsartContext_TypeDef *ctx) {
+  return FIFO_Dropped(&ctx->RxFifo);
+}
+
+/**
+ * @brief Get the RX ring occupancy counters
+ * @param[out] stats receives the counters
+ *
+ * @return
+ * SERIAL_SUCCESS -> stats filled in\n
+ * SERIAL_INVALID_PARAMETER -> stats is a null pointer\n
+ * SERIAL_FAIL -> built without EN_FIFO_STATS
+ */
+SerialResult_t Usart_GetRxFifoStats(UsartContext_TypeDef *ctx, FIFOStats_TypeDef *stats) {
+  if (!stats) {
+    return SERIAL_INVALID_PARAMETER;
+  }
+
+  if (FIFO_GetStats(&ctx->RxFifo, stats)) {
+    return SERIAL_FAIL;
+  }
+
+  return SERIAL_SUCCESS;
+}
+
+/**
+ * @brief Send string over interface
+ * @param source pointer to string
+ *
+ * @return
+ * SERIAL_CLOSED -> Interface is closed and nothing is done\n
+ * SERIAL_INVALID_PARAMETER -> source pointer is a null pointer\n
+ * SERIAL_FAIL -> SendByte failed\n
+ * SERIAL_BUFFER_FULL -> queued modes only, the TX ring was taken by another sender, or it
+ * was full and this was called from an interrupt handler, which queues what fits and never waits\n
+ * SERIAL_SUCCESS -> String has been sent (queued in the DMA and interrupt modes)
+ */
+SerialResult_t Usart_SendString(UsartContext_TypeDef *ctx, const char *source) {
+  if (!ctx->IsOpen) {
+    return SERIAL_CLOSED;
+  }
+
+  if (!source) {
+    return SERIAL_INVALID_PARAMETER;
+  }
+
+  if (ctx->TxMode != SERIAL_TX_BLOCKING) {
+    uint32_t length = 0;
+
+    while (source[length]) {
+      length++;
+    }
+
+    return QueueTx(ctx, (const uint8_t *)source, length);
+  }
+
+  while(*source) {
+    if (Usart_SendByte(ctx, *source)) {
+      return SERIAL_FAIL;
+    }
+    source++;
+  }
+
+  return SERIAL_SUCCESS;
+}
+
+/**
+ * @brief Send string over interface
+ * @param source pointer to byte array
+ * @param length of the byte array
+ *
+ * @return
+ * SERIAL_CLOSED -> Interface is closed and nothing is done\n
+ * SERIAL_INVALID_PARAMETER -> source pointer is a null pointer\n
+ * SERIAL_FAIL -> SendByte failed\n
+ * SERIAL_BUFFER_FULL -> queued modes only, the TX ring was taken by another sender, or it
+ * was full and this was called from an interrupt handler, which queues what fits and never waits\n
+ * SERIAL_SUCCESS -> String has been sent (queued in the DMA and interrupt modes)
+ */
+SerialResult_t Usart_SendArray(UsartContext_TypeDef *ctx, const uint8_t *source, uint32_t length) {
+  if (!ctx->IsOpen) {
+    return SERIAL_CLOSED;
+  }
+
+  if (!source) {
+    return SERIAL_INVALID_PARAMETER;
+  }
+
+  if (ctx->TxMode != SERIAL_TX_BLOCKING) {
+    return QueueTx(ctx, source, length);
+  }
+
+  for ( ; length; length--) {
+    if (Usart_SendByte(ctx, *source)) {
+      return SERIAL_FAIL;
+    }
+    source++;
+  }
+
+  return SERIAL_SUCCESS;
+}
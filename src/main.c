@@ -2,13 +2,57 @@
 #include <MCU/LED/blue_led.h>
 #include <MCU/LED/red_led.h>
 #include "MCU/tick.h"
-#include "MCU/usart3.h"
+#include "MCU/serial_ports.h"
 
 /**
  * @brief Sets the baudrate for the serial port
  */
 #define BAUDRATE 115200
 
+/**
+ * @brief How long to wait at startup for the host's 0x55/0x7F sync character
+ * before falling back to BAUDRATE
+ */
+#define AUTOBAUD_TIMEOUT_MS 2000
+
+/**
+ * @brief Ring sizes for the serial port, the TX ring must be a power of two
+ */
+#define SERIAL_RX_SIZE 32
+#define SERIAL_TX_SIZE 128
+
+static SERIAL_BUFFER(SerialRxStorage, SERIAL_RX_SIZE);
+static SERIAL_BUFFER(SerialTxStorage, SERIAL_TX_STORAGE_SIZE(SERIAL_TX_SIZE));
+
+/**
+ * @brief Serial port settings, both directions go over DMA
+ */
+static const SerialConfig_TypeDef SerialConfig = {
+  BAUDRATE, SERIAL_RX_DMA, SERIAL_TX_DMA,
+  SerialRxStorage, sizeof(SerialRxStorage),
+  SerialTxStorage, SERIAL_TX_SIZE
+};
+
+/**
+ * @brief Receive events the main loop sleeps on, set from the serial ISR
+ */
+static volatile uint32_t SerialEvents;
+
+static void OnSerialEvent(uint32_t events) {
+  SerialEvents |= events;
+}
+
+/**
+ * @brief Wake on a full line, a half full ring or a typing pause
+ */
+static const SerialEventConfig_TypeDef SerialEventConfig = {
+  SERIAL_EVENT_COUNT | SERIAL_EVENT_DELIMITER | SERIAL_EVENT_IDLE,
+  SERIAL_RX_SIZE / 2,
+  '\r',
+  1000,
+  OnSerialEvent
+};
+
 static void PrintHeader(void);
 void HardFault_Handler(void);
 
@@ -22,18 +66,45 @@ void main(void) {
   RedLed.Init();
   BlueLed.Init();
 
-  SerialPort3.Open(BAUDRATE);
+  SerialConfig_TypeDef config = SerialConfig;
+  uint32_t baudrate;
+
+  if (SerialPort3.DetectBaudrate(AUTOBAUD_TIMEOUT_MS, &baudrate) == SERIAL_SUCCESS) {
+    config.Baudrate = baudrate;
+  }
+
+  SerialPort3.Open(&config);
+  SerialPort3.SetEventCallback(&SerialEventConfig);
+  Tick_SetCallback(SerialPorts_Tick);
 
   PrintHeader();
 
-  uint8_t buf[USART_MAX_BUFFER];
-  uint32_t numRead = 0;
+  const uint8_t *data;
+  int32_t numRead = 0;
   for (;;) {
-    numRead = SerialPort3.GetByte(buf, USART_MAX_BUFFER);
-    if (numRead > 0) {
-      SerialPort3.SendArray(buf, numRead);
+    // an event raised after the check still ends the WFI, it is pending
+    __disable_irq();
+    if (!SerialEvents) {
+      __WFI();
+    }
+    __enable_irq();
+
+    SerialEvents = 0;
+
+    // echo straight out of the RX ring, no copy into a local buffer
+    while ((numRead = SerialPort3.PeekBytes(&data)) != 0) {
+      // bytes were lost here, the next peek carries on after them
+      if (numRead == SERIAL_OVER_RUN || numRead == SERIAL_BUFFER_FULL) {
+        continue;
+      }
+
+      if (numRead < 0) {
+        break;
+      }
+
+      SerialPort3.SendArray(data, numRead);
+      SerialPort3.ConsumeBytes(numRead);
     }
-    Tick_DelayMs(500);
   }
 }
 
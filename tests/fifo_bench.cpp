@@ -0,0 +1,261 @@
+/**
+ * @file fifo_bench.cpp
+ * @author Matthew Philyaw (matthew.philyaw@gmail.com)
+ *
+ * @brief Host side FIFO microbenchmarks
+ *
+ * Measures ns per element for each FIFO implementation in the tree:
+ * - c:    FIFOContext_TypeDef from FIFO.c, per element calls go through the setter pointers
+ * - pow2: FIFO_POW2_DEFINE rings with 16 bit positions
+ * - tpl:  Fifo<T, N> from Fifo.hpp
+ *
+ * Workloads:
+ * - single:     write one element then read it back, repeatedly
+ * - bulk:       write then read back blocks of half the capacity (c and tpl only)
+ * - concurrent: producer and consumer threads streaming through the FIFO
+ *
+ * Every combination is run for 8/16/32/64 bit elements and 16/256/4096 element
+ * capacities. Results go to stdout as CSV, one row per case, so runs can be
+ * diffed or plotted to catch regressions:
+ * @code
+ * impl,workload,width,capacity,elements,ns_per_element
+ * @endcode
+ *
+ * Build and run from the repository root (common.h settings such as
+ * EN_FIFO_STATS apply, same as the firmware):
+ * @code
+ * INC="-DSTM32F446xx -Iinclude -Isystem/include -Isystem/include/cmsis -Isystem/include/cmsis/device"
+ * TYPES="-DFIFO_UINT16_T -DFIFO_UINT32_T -DFIFO_UINT64_T"
+ * gcc -std=gnu11 -O2 $INC $TYPES -c src/FIFO.c -o FIFO.o
+ * g++ -std=gnu++11 -O2 $INC $TYPES tests/fifo_bench.cpp FIFO.o -lpthread -o fifo_bench
+ * ./fifo_bench > fifo_bench.csv
+ * @endcode
+ * An optional argument scales the element count of every case (default 1).
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "FIFO.h"
+#include "FIFO_Pow2.h"
+#include "Fifo.hpp"
+
+static uint32_t Scale = 1;
+static volatile uint64_t Sink;
+
+static uint64_t NowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void Report(const char *impl, const char *workload, uint32_t width, uint32_t capacity, uint64_t elements, uint64_t ns) {
+  printf("%s,%s,%u,%u,%llu,%.3f\n", impl, workload, width * 8, capacity, (unsigned long long)elements, (double)ns / elements);
+}
+
+/**********************************************************************
+*             Adapters giving every FIFO the same shape              *
+**********************************************************************/
+
+template <typename T> struct CSetter;
+#define C_SETTER(type) \
+template <> struct CSetter<type> { \
+  static void Set(void *addr, void *val) { TOKENPASTE2(FIFO_Set_, type)(addr, val); } \
+  static void Get(void *addr, void *val) { TOKENPASTE2(FIFO_Get_, type)(addr, val); } \
+}
+C_SETTER(uint8_t);
+C_SETTER(uint16_t);
+C_SETTER(uint32_t);
+C_SETTER(uint64_t);
+
+template <typename T, uint32_t N>
+struct CFifo {
+  static const bool HasBulk = true;
+  FIFOContext_TypeDef ctx;
+  T buffer[N];
+
+  void Init() { FIFO_Init(&ctx, N, sizeof(T), buffer); }
+  bool Push(T val) { return !FIFO_Write(&ctx, CSetter<T>::Set, &val); }
+  bool Pop(T &val) { return !FIFO_Read(&ctx, CSetter<T>::Get, &val); }
+  uint32_t PushN(const T *source, uint32_t count) { return FIFO_WriteN(&ctx, source, count); }
+  uint32_t PopN(T *destination, uint32_t count) { return FIFO_ReadN(&ctx, destination, count); }
+};
+
+template <typename T, uint32_t N>
+struct TplFifo {
+  static const bool HasBulk = true;
+  Fifo<T, N> fifo;
+
+  void Init() { fifo.Init(); }
+  bool Push(T val) { return !fifo.Push(val); }
+  bool Pop(T &val) { return !fifo.Pop(val); }
+  uint32_t PushN(const T *source, uint32_t count) { return fifo.PushN(source, count); }
+  uint32_t PopN(T *destination, uint32_t count) { return fifo.PopN(destination, count); }
+};
+
+#define POW2_NAME(type, sizeLog2) TOKENPASTE2(Ring_, TOKENPASTE2(type, TOKENPASTE2(_, sizeLog2)))
+#define POW2_API(type, sizeLog2, suffix) TOKENPASTE2(POW2_NAME(type, sizeLog2), suffix)
+
+#define POW2_RINGS(type) \
+FIFO_POW2_DEFINE(POW2_NAME(type, 4), type, 4, uint16_t) \
+FIFO_POW2_DEFINE(POW2_NAME(type, 8), type, 8, uint16_t) \
+FIFO_POW2_DEFINE(POW2_NAME(type, 12), type, 12, uint16_t)
+POW2_RINGS(uint8_t)
+POW2_RINGS(uint16_t)
+POW2_RINGS(uint32_t)
+POW2_RINGS(uint64_t)
+
+template <typename T, uint32_t N> struct Pow2Fifo;
+#define POW2_ADAPTER(type, sizeLog2) \
+template <> struct Pow2Fifo<type, (1U << sizeLog2)> { \
+  static const bool HasBulk = false; \
+  POW2_API(type, sizeLog2, _TypeDef) ring; \
+  void Init() { POW2_API(type, sizeLog2, _Init)(&ring); } \
+  bool Push(type val) { return !POW2_API(type, sizeLog2, _Write)(&ring, val); } \
+  bool Pop(type &val) { return !POW2_API(type, sizeLog2, _Read)(&ring, &val); } \
+  uint32_t PushN(const type *, uint32_t) { return 0; } \
+  uint32_t PopN(type *, uint32_t) { return 0; } \
+};
+
+#define POW2_ADAPTERS(type) POW2_ADAPTER(type, 4) POW2_ADAPTER(type, 8) POW2_ADAPTER(type, 12)
+POW2_ADAPTERS(uint8_t)
+POW2_ADAPTERS(uint16_t)
+POW2_ADAPTERS(uint32_t)
+POW2_ADAPTERS(uint64_t)
+
+/**********************************************************************
+*                             Workloads                              *
+**********************************************************************/
+
+template <typename F, typename T, uint32_t N>
+static void Single(const char *impl) {
+  static F fifo;
+  uint64_t elements = 4000000ULL * Scale;
+  T val = 0;
+  uint64_t sum = 0;
+
+  fifo.Init();
+
+  uint64_t start = NowNs();
+  for (uint64_t i = 0; i < elements; i++) {
+    fifo.Push((T)i);
+    fifo.Pop(val);
+    sum += val;
+  }
+  uint64_t ns = NowNs() - start;
+
+  Sink = sum;
+  Report(impl, "single", sizeof(T), N, elements, ns);
+}
+
+template <typename F, typename T, uint32_t N>
+static void Bulk(const char *impl) {
+  static F fifo;
+  static T block[N / 2];
+  uint64_t elements = 0;
+  uint64_t target = 16000000ULL * Scale;
+  uint64_t sum = 0;
+
+  if (!F::HasBulk) {
+    return;
+  }
+
+  fifo.Init();
+  for (uint32_t i = 0; i < N / 2; i++) {
+    block[i] = (T)i;
+  }
+
+  uint64_t start = NowNs();
+  while (elements < target) {
+    uint32_t written = fifo.PushN(block, N / 2);
+    elements += fifo.PopN(block, written);
+    sum += block[0];
+  }
+  uint64_t ns = NowNs() - start;
+
+  Sink = sum;
+  Report(impl, "bulk", sizeof(T), N, elements, ns);
+}
+
+template <typename F, typename T>
+struct ConcurrentArgs {
+  F *Fifo;
+  uint64_t Elements;
+};
+
+template <typename F, typename T>
+static void *ConcurrentProducer(void *arg) {
+  ConcurrentArgs<F, T> *args = (ConcurrentArgs<F, T> *)arg;
+
+  for (uint64_t i = 0; i < args->Elements; ) {
+    if (args->Fifo->Push((T)i)) {
+      i++;
+    }
+    else {
+      sched_yield();
+    }
+  }
+
+  return NULL;
+}
+
+template <typename F, typename T, uint32_t N>
+static void Concurrent(const char *impl) {
+  static F fifo;
+  ConcurrentArgs<F, T> args = { &fifo, 1000000ULL * Scale };
+  pthread_t producer;
+  uint64_t sum = 0;
+  T val;
+
+  fifo.Init();
+
+  uint64_t start = NowNs();
+  pthread_create(&producer, NULL, ConcurrentProducer<F, T>, &args);
+  for (uint64_t i = 0; i < args.Elements; ) {
+    if (fifo.Pop(val)) {
+      sum += val;
+      i++;
+    }
+    else {
+      sched_yield();
+    }
+  }
+  pthread_join(producer, NULL);
+  uint64_t ns = NowNs() - start;
+
+  Sink = sum;
+  Report(impl, "concurrent", sizeof(T), N, args.Elements, ns);
+}
+
+template <typename T, uint32_t N>
+static void RunAll(void) {
+  Single<CFifo<T, N>, T, N>("c");
+  Single<Pow2Fifo<T, N>, T, N>("pow2");
+  Single<TplFifo<T, N>, T, N>("tpl");
+  Bulk<CFifo<T, N>, T, N>("c");
+  Bulk<TplFifo<T, N>, T, N>("tpl");
+  Concurrent<CFifo<T, N>, T, N>("c");
+  Concurrent<Pow2Fifo<T, N>, T, N>("pow2");
+  Concurrent<TplFifo<T, N>, T, N>("tpl");
+}
+
+template <typename T>
+static void RunWidth(void) {
+  RunAll<T, 16>();
+  RunAll<T, 256>();
+  RunAll<T, 4096>();
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    Scale = (uint32_t)atoi(argv[1]);
+  }
+
+  printf("impl,workload,width,capacity,elements,ns_per_element\n");
+
+  RunWidth<uint8_t>();
+  RunWidth<uint16_t>();
+  RunWidth<uint32_t>();
+  RunWidth<uint64_t>();
+
+  return 0;
+}
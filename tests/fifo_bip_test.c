@@ -0,0 +1,283 @@
+/**
+ * @file fifo_bip_test.c
+ * @author Matthew Philyaw (matthew.philyaw@gmail.com)
+ *
+ * @brief Host side test for the bip buffer
+ *
+ * The wrap is walked through by hand first: a reservation that doesn't fit
+ * the tail starts at index 0 and leaves a watermark, Peek returns what is
+ * left up to the watermark and then follows it back to 0, and the write
+ * position never catches up with the read position. ReserveMax is checked
+ * in each of the three states it picks a run from.
+ *
+ * Then a producer and a consumer thread race with variable length
+ * reservations, the consumer checks it reads an unbroken incrementing byte
+ * sequence and that every region it gets is inside the buffer.
+ *
+ * Build and run from the repository root:
+ * @code
+ * gcc -std=gnu11 -O2 -Wall -DSTM32F446xx \
+ *   -Iinclude -Isystem/include -Isystem/include/cmsis -Isystem/include/cmsis/device \
+ *   src/FIFO_Bip.c tests/fifo_bip_test.c -lpthread -o fifo_bip_test && ./fifo_bip_test
+ * @endcode
+ */
+#include <pthread.h>
+#include <sched.h>
+#include "FIFO_Bip.h"
+
+#define ITERATIONS 4000000UL
+#define BUFFER_SIZE 61
+
+static uint32_t Failures;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond) && Failures++ < 10) { \
+      printf("  line %d: %s\n", __LINE__, #cond); \
+    } \
+  } while (0)
+
+static int Run(const char *name, void (*test)(void)) {
+  Failures = 0;
+  test();
+  printf("%s %s: %u failures\n", Failures ? "FAIL" : "PASS", name, Failures);
+  return Failures ? 1 : 0;
+}
+
+/**
+ * @brief Reserve, fill with value, value + 1, ... and commit count bytes
+ */
+static int_fast8_t WriteRun(FIFOBipContext_TypeDef *ctx, uint32_t count, uint8_t value) {
+  uint8_t *region;
+
+  if (FIFO_Bip_Reserve(ctx, count, (void **)&region)) {
+    return -1;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    region[i] = value + i;
+  }
+
+  return FIFO_Bip_Commit(ctx, count);
+}
+
+static void TestWrap(void) {
+  static uint8_t buffer[32];
+  FIFOBipContext_TypeDef ctx;
+  const uint8_t *data;
+  void *region;
+
+  CHECK(FIFO_Bip_Init(&ctx, 1, buffer) == -1);
+  CHECK(FIFO_Bip_Init(&ctx, sizeof(buffer), buffer) == 0);
+  CHECK(FIFO_Bip_Peek(&ctx, (const void **)&data) == 0);
+
+  CHECK(WriteRun(&ctx, 20, 0) == 0);
+  CHECK(WriteRun(&ctx, 8, 20) == 0);
+  CHECK(FIFO_Bip_Consume(&ctx, 29) == -1);
+  CHECK(FIFO_Bip_Consume(&ctx, 16) == 0);
+
+  // 6 bytes don't fit the 4 byte tail, they go to 0 and the tail is given up
+  CHECK(FIFO_Bip_Reserve(&ctx, 6, &region) == 0);
+  CHECK(region == buffer);
+  CHECK(FIFO_Bip_Commit(&ctx, 7) == -1);
+  for (uint32_t i = 0; i < 6; i++) {
+    ((uint8_t *)region)[i] = 28 + i;
+  }
+  CHECK(FIFO_Bip_Commit(&ctx, 6) == 0);
+  CHECK(ctx.Watermark == 28);
+  CHECK(ctx.WritePos == 6);
+
+  // the tail is read up to the watermark, not to the end of the buffer
+  CHECK(FIFO_Bip_Peek(&ctx, (const void **)&data) == 12);
+  CHECK(data == buffer + 16 && data[0] == 16 && data[11] == 27);
+  CHECK(FIFO_Bip_Consume(&ctx, 13) == -1);
+  CHECK(FIFO_Bip_Consume(&ctx, 12) == 0);
+
+  // then it follows the watermark back to 0
+  CHECK(FIFO_Bip_Peek(&ctx, (const void **)&data) == 6);
+  CHECK(data == buffer && data[0] == 28 && data[5] == 33);
+
+  // back at 0 the tail after WritePos is free again, the start is not
+  CHECK(FIFO_Bip_Reserve(&ctx, 27, &region) == -1);
+  CHECK(FIFO_Bip_Consume(&ctx, 2) == 0);
+  CHECK(WriteRun(&ctx, 26, 34) == 0);
+  CHECK(FIFO_Bip_Peek(&ctx, (const void **)&data) == 30);
+  CHECK(data == buffer + 2 && data[0] == 30 && data[29] == 59);
+
+  // a wrap must stay short of ReadPos, landing on it would read back as empty
+  CHECK(FIFO_Bip_Reserve(&ctx, 2, &region) == -1);
+  CHECK(FIFO_Bip_Reserve(&ctx, 1, &region) == 0);
+  CHECK(region == buffer);
+  *(uint8_t *)region = 60;
+  CHECK(FIFO_Bip_Commit(&ctx, 1) == 0);
+  CHECK(ctx.Watermark == 32);
+
+  // same once wrapped, the free run is between WritePos and ReadPos
+  CHECK(FIFO_Bip_Reserve(&ctx, 1, &region) == -1);
+  CHECK(FIFO_Bip_ReserveMax(&ctx, &region) == 0);
+
+  // a zero length commit of a wrapped reservation leaves nothing behind
+  CHECK(FIFO_Bip_Consume(&ctx, 30) == 0);
+  CHECK(FIFO_Bip_Peek(&ctx, (const void **)&data) == 1);
+  CHECK(data == buffer && data[0] == 60);
+  CHECK(FIFO_Bip_Consume(&ctx, 1) == 0);
+  CHECK(WriteRun(&ctx, 30, 61) == 0);
+  CHECK(FIFO_Bip_Consume(&ctx, 30) == 0);
+  CHECK(FIFO_Bip_Reserve(&ctx, 8, &region) == 0);
+  CHECK(region == buffer);
+  CHECK(FIFO_Bip_Commit(&ctx, 0) == 0);
+  CHECK(ctx.WritePos == 31);
+  CHECK(FIFO_Bip_Peek(&ctx, (const void **)&data) == 0);
+}
+
+static void TestReserveMax(void) {
+  static uint8_t buffer[16];
+  FIFOBipContext_TypeDef ctx;
+  const uint8_t *data;
+  void *region;
+
+  CHECK(FIFO_Bip_Init(&ctx, sizeof(buffer), buffer) == 0);
+
+  // empty, the whole buffer
+  CHECK(FIFO_Bip_ReserveMax(&ctx, &region) == 16);
+  CHECK(region == buffer);
+  CHECK(FIFO_Bip_Commit(&ctx, 10) == 0);
+
+  // the tail is preferred while it has room, even with room at the start
+  CHECK(FIFO_Bip_Consume(&ctx, 8) == 0);
+  CHECK(FIFO_Bip_ReserveMax(&ctx, &region) == 6);
+  CHECK(region == buffer + 10);
+  CHECK(FIFO_Bip_Commit(&ctx, 6) == 0);
+
+  // tail full, it wraps to 0 and stops one short of ReadPos
+  CHECK(FIFO_Bip_ReserveMax(&ctx, &region) == 7);
+  CHECK(region == buffer);
+  CHECK(FIFO_Bip_Commit(&ctx, 3) == 0);
+  CHECK(ctx.Watermark == 16);
+
+  // wrapped, the run between WritePos and ReadPos
+  CHECK(FIFO_Bip_ReserveMax(&ctx, &region) == 4);
+  CHECK(region == buffer + 3);
+  CHECK(FIFO_Bip_Commit(&ctx, 4) == 0);
+  CHECK(FIFO_Bip_ReserveMax(&ctx, &region) == 0);
+  CHECK(FIFO_Bip_Commit(&ctx, 1) == -1);
+
+  CHECK(FIFO_Bip_Peek(&ctx, (const void **)&data) == 8);
+  CHECK(FIFO_Bip_Consume(&ctx, 8) == 0);
+  CHECK(FIFO_Bip_Peek(&ctx, (const void **)&data) == 7);
+  CHECK(data == buffer);
+  CHECK(FIFO_Bip_Consume(&ctx, 7) == 0);
+
+  // full without wrapping, ReadPos at 0 leaves nothing at the start
+  CHECK(FIFO_Bip_Init(&ctx, sizeof(buffer), buffer) == 0);
+  CHECK(FIFO_Bip_ReserveMax(&ctx, &region) == 16);
+  CHECK(FIFO_Bip_Commit(&ctx, 16) == 0);
+  CHECK(FIFO_Bip_ReserveMax(&ctx, &region) == 0);
+  CHECK(FIFO_Bip_Peek(&ctx, (const void **)&data) == 16);
+}
+
+static uint8_t raceBuffer[BUFFER_SIZE];
+static FIFOBipContext_TypeDef raceFifo;
+
+static void *Producer(void *arg) {
+  uint8_t value = 0;
+  (void)arg;
+
+  for (uint32_t sent = 0, round = 0; sent < ITERATIONS; round++) {
+    uint32_t count = (round % 23) + 1;
+
+    if (count > ITERATIONS - sent) {
+      count = ITERATIONS - sent;
+    }
+
+    // every other round takes whatever run is free instead
+    if (round & 1) {
+      uint8_t *region;
+      uint32_t length = FIFO_Bip_ReserveMax(&raceFifo, (void **)&region);
+
+      if (length > count) {
+        length = count;
+      }
+
+      for (uint32_t i = 0; i < length; i++) {
+        region[i] = value + i;
+      }
+
+      if (length) {
+        FIFO_Bip_Commit(&raceFifo, length);
+      }
+      else {
+        sched_yield();
+      }
+
+      value += length;
+      sent += length;
+      continue;
+    }
+
+    if (WriteRun(&raceFifo, count, value)) {
+      sched_yield();
+      continue;
+    }
+
+    value += count;
+    sent += count;
+  }
+
+  return NULL;
+}
+
+static void *Consumer(void *arg) {
+  const uint8_t *data;
+  uint8_t expected = 0;
+  (void)arg;
+
+  for (uint32_t received = 0; received < ITERATIONS; ) {
+    uint32_t length = FIFO_Bip_Peek(&raceFifo, (const void **)&data);
+
+    if (!length) {
+      sched_yield();
+      continue;
+    }
+
+    if ((data < raceBuffer || data + length > raceBuffer + BUFFER_SIZE) && Failures++ < 10) {
+      printf("  region %td + %u outside the buffer\n", data - raceBuffer, length);
+    }
+
+    for (uint32_t i = 0; i < length; i++) {
+      if (data[i] != expected && Failures++ < 10) {
+        printf("  expected %u got %u at %u\n", expected, data[i], received + i);
+      }
+      expected = data[i] + 1;
+    }
+
+    FIFO_Bip_Consume(&raceFifo, length);
+    received += length;
+  }
+
+  return NULL;
+}
+
+static void TestRace(void) {
+  pthread_t producer, consumer;
+
+  CHECK(FIFO_Bip_Init(&raceFifo, sizeof(raceBuffer), raceBuffer) == 0);
+
+  pthread_create(&consumer, NULL, Consumer, NULL);
+  pthread_create(&producer, NULL, Producer, NULL);
+  pthread_join(producer, NULL);
+  pthread_join(consumer, NULL);
+
+  const void *data;
+  CHECK(FIFO_Bip_Peek(&raceFifo, &data) == 0);
+}
+
+int main(void) {
+  int failed = 0;
+
+  failed |= Run("wrap and watermark", TestWrap);
+  failed |= Run("reserve max", TestReserveMax);
+  failed |= Run("producer consumer race", TestRace);
+
+  return failed;
+}
@@ -0,0 +1,268 @@
+/**
+ * @file fifo_broadcast_test.c
+ * @author Matthew Philyaw (matthew.philyaw@gmail.com)
+ *
+ * @brief Host side test for the broadcast byte ring
+ *
+ * Every byte written is the low 8 bits of its own stream position, so a
+ * reader can tell from its cursor what each byte it reads should be. The
+ * ring sizes are below 256, a byte overwritten by one a lap later never
+ * looks right.
+ *
+ * The lagging reader cases are walked through by hand: readers keep
+ * separate cursors, a reader more than a lap behind is skipped ahead to the
+ * oldest byte with the gap in Lost and Overrun raised, and a single write
+ * larger than the ring keeps only its tail.
+ *
+ * Then a producer thread writes without ever waiting for room while
+ * reader threads read at different speeds, one of them small reads with
+ * pauses so it is lapped constantly. Each checks every byte it gets against
+ * its cursor, so a byte the producer overwrote mid read fails the test, and
+ * that what it read plus Lost adds up to everything written. A reader is only
+ * lapped in the middle of a copy often enough to matter with the producer on
+ * another core, on a single core machine that part of the race seldom runs.
+ *
+ * Build and run from the repository root:
+ * @code
+ * gcc -std=gnu11 -O2 -Wall -DSTM32F446xx \
+ *   -Iinclude -Isystem/include -Isystem/include/cmsis -Isystem/include/cmsis/device \
+ *   src/FIFO_Broadcast.c tests/fifo_broadcast_test.c -lpthread -o fifo_broadcast_test && ./fifo_broadcast_test
+ * @endcode
+ */
+#include <pthread.h>
+#include <sched.h>
+#include "FIFO_Broadcast.h"
+
+#define READERS 3
+#define CHUNK 37
+
+static uint32_t Failures;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond) && Failures++ < 10) { \
+      printf("  line %d: %s\n", __LINE__, #cond); \
+    } \
+  } while (0)
+
+static int Run(const char *name, void (*test)(void)) {
+  Failures = 0;
+  test();
+  printf("%s %s: %u failures\n", Failures ? "FAIL" : "PASS", name, Failures);
+  return Failures ? 1 : 0;
+}
+
+/**
+ * @brief Write count bytes of the position stream starting at *next
+ */
+static void WriteStream(FIFOBroadcastContext_TypeDef *ctx, uint32_t *next, uint32_t count) {
+  uint8_t chunk[256];
+
+  for (uint32_t i = 0; i < count; i++) {
+    chunk[i] = (uint8_t)(*next + i);
+  }
+
+  FIFO_Broadcast_Write(ctx, chunk, count);
+  *next += count;
+}
+
+/**
+ * @brief Check length bytes just read end at the reader's cursor
+ */
+static uint_fast8_t StreamMatches(const FIFOBroadcastReader_TypeDef *reader, const uint8_t *data, uint32_t length) {
+  uint32_t pos = reader->ReadPos - length;
+
+  for (uint32_t i = 0; i < length; i++) {
+    if (data[i] != (uint8_t)(pos + i)) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+static void TestLaggingReader(void) {
+  static uint8_t buffer[16];
+  FIFOBroadcastContext_TypeDef ctx;
+  FIFOBroadcastReader_TypeDef fast, slow, late;
+  uint8_t data[64];
+  uint32_t next = 0;
+
+  CHECK(FIFO_Broadcast_Init(&ctx, 12, buffer) == -1);
+  CHECK(FIFO_Broadcast_Init(&ctx, sizeof(buffer), buffer) == 0);
+  FIFO_Broadcast_ReaderInit(&fast, &ctx);
+  FIFO_Broadcast_ReaderInit(&slow, &ctx);
+  CHECK(FIFO_Broadcast_ReadN(&fast, data, sizeof(data)) == 0);
+
+  // both readers see the same bytes, each at its own pace
+  WriteStream(&ctx, &next, 10);
+  CHECK(FIFO_Broadcast_ReadN(&fast, data, 4) == 4);
+  CHECK(StreamMatches(&fast, data, 4));
+  CHECK(FIFO_Broadcast_Lag(&fast) == 6);
+  CHECK(FIFO_Broadcast_Lag(&slow) == 10);
+  CHECK(FIFO_Broadcast_ReadN(&fast, data, sizeof(data)) == 6);
+  CHECK(StreamMatches(&fast, data, 6));
+
+  // a reader attached now starts at the next byte written
+  FIFO_Broadcast_ReaderInit(&late, &ctx);
+  CHECK(FIFO_Broadcast_Lag(&late) == 0);
+
+  // exactly a lap behind is still whole
+  WriteStream(&ctx, &next, 6);
+  CHECK(FIFO_Broadcast_Lag(&slow) == 16);
+  CHECK(FIFO_Broadcast_ReadN(&slow, data, 8) == 8);
+  CHECK(StreamMatches(&slow, data, 8) && data[0] == 0);
+  CHECK(!FIFO_Broadcast_CheckOverrun(&slow));
+  CHECK(FIFO_Broadcast_ReadN(&fast, data, sizeof(data)) == 6);
+
+  // 8 unread plus 13 more, the slow reader loses the 5 oldest
+  WriteStream(&ctx, &next, 13);
+  CHECK(FIFO_Broadcast_Lag(&slow) == 21);
+  CHECK(FIFO_Broadcast_ReadN(&slow, data, sizeof(data)) == 16);
+  CHECK(StreamMatches(&slow, data, 16) && data[0] == 13);
+  CHECK(slow.Lost == 5);
+  CHECK(FIFO_Broadcast_CheckOverrun(&slow));
+  CHECK(!FIFO_Broadcast_CheckOverrun(&slow));
+
+  // the fast reader was never a lap behind and lost nothing
+  CHECK(FIFO_Broadcast_ReadN(&fast, data, sizeof(data)) == 13);
+  CHECK(StreamMatches(&fast, data, 13));
+  CHECK(fast.Lost == 0 && !FIFO_Broadcast_CheckOverrun(&fast));
+  CHECK(FIFO_Broadcast_ReadN(&late, data, sizeof(data)) == 16);
+  CHECK(late.Lost == 3);
+
+  // one write bigger than the ring only leaves its last 16 bytes
+  WriteStream(&ctx, &next, 40);
+  CHECK(FIFO_Broadcast_ReadN(&fast, data, sizeof(data)) == 16);
+  CHECK(StreamMatches(&fast, data, 16) && data[15] == (uint8_t)(next - 1));
+  CHECK(fast.Lost == 24);
+
+  // lost keeps adding up across several laps
+  WriteStream(&ctx, &next, 100);
+  WriteStream(&ctx, &next, 100);
+  CHECK(FIFO_Broadcast_ReadN(&slow, data, 10) == 10);
+  CHECK(StreamMatches(&slow, data, 10));
+  CHECK(slow.Lost == 5 + 40 + 200 - 16);
+  CHECK(FIFO_Broadcast_Lag(&slow) == 6);
+}
+
+/**
+ * @brief One reader thread, Pause makes it read slowly enough to be lapped
+ */
+typedef struct {
+  FIFOBroadcastReader_TypeDef Reader;
+  uint32_t ReadSize;
+  uint_fast8_t Pause;
+  uint32_t Target;
+  volatile uint32_t Received;
+  uint32_t Failures;
+} ReaderTest;
+
+static FIFOBroadcastContext_TypeDef raceFifo;
+static uint8_t raceBuffer[64];
+static ReaderTest raceReaders[READERS] = {
+  { .ReadSize = 128, .Target = 20000000 },
+  { .ReadSize = 7, .Target = 20000000 },
+  { .ReadSize = 3, .Pause = TRUE, .Target = 1000000 },
+};
+static uint32_t raceWritten;
+static volatile uint_fast8_t raceDone;
+
+/**
+ * @brief Keep writing until every reader has read its Target bytes
+ *
+ * Stopping on what the readers got rather than on a byte count makes sure
+ * they get to run while the producer is still writing, however the threads
+ * are scheduled.
+ */
+static void *Producer(void *arg) {
+  uint8_t chunk[CHUNK];
+  uint32_t next = 0;
+  uint32_t writes = 0;
+  (void)arg;
+
+  for (uint32_t i = 0; i < READERS; i++) {
+    while (raceReaders[i].Received < raceReaders[i].Target) {
+      uint32_t length = 1 + next % CHUNK;
+
+      for (uint32_t j = 0; j < length; j++) {
+        chunk[j] = (uint8_t)(next + j);
+      }
+
+      FIFO_Broadcast_Write(&raceFifo, chunk, length);
+      next += length;
+
+      // never waits for room, only lets the readers run now and then
+      if (!(++writes % 16)) {
+        sched_yield();
+      }
+    }
+  }
+
+  raceWritten = next;
+  raceDone = TRUE;
+  return NULL;
+}
+
+static void *Reader(void *arg) {
+  ReaderTest *test = arg;
+  uint8_t data[128];
+
+  for (;;) {
+    uint_fast8_t done = raceDone;
+    uint32_t length = FIFO_Broadcast_ReadN(&test->Reader, data, test->ReadSize);
+
+    if (!StreamMatches(&test->Reader, data, length) && test->Failures++ < 10) {
+      printf("  torn read of %u bytes ending at %u\n", length, test->Reader.ReadPos);
+    }
+
+    test->Received += length;
+
+    if (!length) {
+      if (done) {
+        break;
+      }
+      sched_yield();
+    }
+    else if (test->Pause) {
+      sched_yield();
+    }
+  }
+
+  return NULL;
+}
+
+static void TestRace(void) {
+  ReaderTest *readers = raceReaders;
+  pthread_t producer, reader[READERS];
+
+  CHECK(FIFO_Broadcast_Init(&raceFifo, sizeof(raceBuffer), raceBuffer) == 0);
+  raceDone = FALSE;
+
+  for (uint32_t i = 0; i < READERS; i++) {
+    FIFO_Broadcast_ReaderInit(&readers[i].Reader, &raceFifo);
+    pthread_create(&reader[i], NULL, Reader, &readers[i]);
+  }
+
+  pthread_create(&producer, NULL, Producer, NULL);
+  pthread_join(producer, NULL);
+
+  for (uint32_t i = 0; i < READERS; i++) {
+    pthread_join(reader[i], NULL);
+
+    Failures += readers[i].Failures;
+    CHECK(readers[i].Received + readers[i].Reader.Lost == raceWritten);
+    printf("  reader %u: read %u, lost %u\n", i, readers[i].Received, readers[i].Reader.Lost);
+  }
+
+  // the slow reader must actually have been lapped for this to mean anything
+  CHECK(readers[READERS - 1].Reader.Lost > 0);
+}
+
+int main(void) {
+  int failed = 0;
+
+  failed |= Run("lagging reader", TestLaggingReader);
+  failed |= Run("wrapping producer race", TestRace);
+
+  return failed;
+}
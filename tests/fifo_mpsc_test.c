@@ -0,0 +1,131 @@
+/**
+ * @file fifo_mpsc_test.c
+ * @author Matthew Philyaw (matthew.philyaw@gmail.com)
+ *
+ * @brief Host side stress test for the multi producer/single consumer FIFO
+ *
+ * Several producer threads stand in for SysTick_Handler, USART3_IRQHandler
+ * and main(). Each writes 4 byte messages {id, sequence} and retries when the
+ * ring is full. The consumer reassembles the stream and checks that no
+ * message is torn or interleaved with another and that every producer's
+ * sequence arrives complete and in order.
+ *
+ * Build and run from the repository root:
+ * @code
+ * gcc -std=gnu11 -O2 -Wall -DSTM32F446xx \
+ *   -Iinclude -Isystem/include -Isystem/include/cmsis -Isystem/include/cmsis/device \
+ *   src/FIFO_MPSC.c tests/fifo_mpsc_test.c -lpthread -o fifo_mpsc_test && ./fifo_mpsc_test
+ * @endcode
+ */
+#include <pthread.h>
+#include <sched.h>
+#include "FIFO_MPSC.h"
+
+#define PRODUCERS 3
+#define MESSAGES 300000UL
+#define MESSAGE_LENGTH 4
+
+static FIFOMPSCContext_TypeDef fifo;
+
+static void *Producer(void *arg) {
+  uint8_t id = (uint8_t)(uintptr_t)arg;
+  uint8_t message[MESSAGE_LENGTH];
+
+  for (uint32_t seq = 0; seq < MESSAGES; ) {
+    message[0] = id;
+    message[1] = seq & 0xFF;
+    message[2] = (seq >> 8) & 0xFF;
+    message[3] = (seq >> 16) & 0xFF;
+
+    if (FIFO_MPSC_Write(&fifo, message, MESSAGE_LENGTH)) {
+      sched_yield();
+      continue;
+    }
+    seq++;
+  }
+
+  return NULL;
+}
+
+static uint32_t RunCase(uint32_t maxSize, uint_fast8_t peek) {
+  uint8_t buffer[maxSize];
+  uint8_t ready[maxSize];
+  uint8_t message[MESSAGE_LENGTH];
+  uint32_t fill = 0;
+  uint32_t expected[PRODUCERS] = { 0 };
+  uint32_t received = 0;
+  uint32_t failures = 0;
+  pthread_t producers[PRODUCERS];
+
+  FIFO_MPSC_Init(&fifo, maxSize, buffer, ready);
+
+  for (uintptr_t i = 0; i < PRODUCERS; i++) {
+    pthread_create(&producers[i], NULL, Producer, (void *)i);
+  }
+
+  while (received < PRODUCERS * MESSAGES) {
+    uint8_t chunk[16];
+    const uint8_t *data = chunk;
+    uint32_t length;
+
+    if (peek) {
+      length = FIFO_MPSC_PeekContiguous(&fifo, &data);
+    }
+    else {
+      length = FIFO_MPSC_ReadN(&fifo, chunk, sizeof(chunk));
+    }
+
+    if (!length) {
+      sched_yield();
+      continue;
+    }
+
+    for (uint32_t i = 0; i < length; i++) {
+      message[fill++] = data[i];
+
+      if (fill < MESSAGE_LENGTH) {
+        continue;
+      }
+      fill = 0;
+
+      uint32_t seq = message[1] | (message[2] << 8) | (message[3] << 16);
+
+      if (message[0] >= PRODUCERS || seq != expected[message[0]]) {
+        if (failures++ < 10) {
+          printf("  producer %u sent %u\n", message[0], seq);
+        }
+        continue;
+      }
+
+      expected[message[0]]++;
+      received++;
+    }
+
+    if (peek) {
+      FIFO_MPSC_Consume(&fifo, length);
+    }
+  }
+
+  for (uint32_t i = 0; i < PRODUCERS; i++) {
+    pthread_join(producers[i], NULL);
+  }
+
+  if (FIFO_MPSC_Count(&fifo) != 0) {
+    failures++;
+  }
+
+  printf("%s size %u%s: %u failures\n", failures ? "FAIL" : "PASS", maxSize, peek ? " peek" : "", failures);
+  return failures;
+}
+
+int main(void) {
+  const uint32_t sizes[] = { 4, 8, 64, 1024 };
+  uint32_t failed = 0;
+
+  for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    failed += RunCase(sizes[i], FALSE);
+    failed += RunCase(sizes[i], TRUE);
+  }
+
+  return failed ? 1 : 0;
+}
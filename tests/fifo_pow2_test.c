@@ -0,0 +1,165 @@
+/**
+ * @file fifo_pow2_test.c
+ * @author Matthew Philyaw (matthew.philyaw@gmail.com)
+ *
+ * @brief Host side test for the FIFO_POW2_DEFINE rings
+ *
+ * The positions of a pow2 ring are free running in the caller's index type,
+ * so a uint8_t or uint16_t ring overflows its positions every 256 or 65536
+ * elements. Each ring is driven through many position overflows with the
+ * fill level swept from empty to full, checking Count/Space, that a full ring
+ * rejects a write, that an empty ring rejects a read and that every element
+ * comes back in order. The largest capacity each index type allows (half its
+ * range) is included since that is where full and empty are closest to
+ * aliasing.
+ *
+ * A producer and a consumer thread then race a uint8_t ring the same way
+ * fifo_spsc_test.c races FIFOContext_TypeDef.
+ *
+ * Build and run from the repository root:
+ * @code
+ * gcc -std=gnu11 -O2 -Wall -DSTM32F446xx \
+ *   -Iinclude -Isystem/include -Isystem/include/cmsis -Isystem/include/cmsis/device \
+ *   tests/fifo_pow2_test.c -lpthread -o fifo_pow2_test && ./fifo_pow2_test
+ * @endcode
+ */
+#include <pthread.h>
+#include <sched.h>
+#include "FIFO_Pow2.h"
+
+#define ITERATIONS 2000000UL
+
+FIFO_POW2_DEFINE(Ring8x1, uint32_t, 0, uint8_t)
+FIFO_POW2_DEFINE(Ring8x8, uint32_t, 3, uint8_t)
+FIFO_POW2_DEFINE(Ring8x128, uint32_t, 7, uint8_t)
+FIFO_POW2_DEFINE(Ring16x16, uint32_t, 4, uint16_t)
+FIFO_POW2_DEFINE(Ring16x32768, uint32_t, 15, uint16_t)
+
+static uint32_t Failures;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond) && Failures++ < 10) { \
+      printf("  line %d: %s\n", __LINE__, #cond); \
+    } \
+  } while (0)
+
+/**
+ * @brief Sweep the fill level of one ring type over total elements
+ *
+ * Each round writes until the ring is full or fill elements are in, then
+ * reads all but keep back out, so the read and write positions overflow at
+ * every possible offset from each other.
+ */
+#define SWEEP(name, capacity, total) \
+  do { \
+    static TOKENPASTE2(name, _TypeDef) ring; \
+    uint32_t next = 0; \
+    uint32_t expected = 0; \
+    uint32_t value = 0; \
+    uint32_t round = 0; \
+    TOKENPASTE2(name, _Init)(&ring); \
+    CHECK(TOKENPASTE2(name, _Read)(&ring, &value) == -1); \
+    CHECK(TOKENPASTE2(name, _Space)(&ring) == (capacity)); \
+    while (next < (total)) { \
+      uint32_t fill = (round % ((capacity) + 1)); \
+      uint32_t keep = (round / ((capacity) + 1)) % ((capacity) + 1); \
+      round++; \
+      while (TOKENPASTE2(name, _Count)(&ring) < fill) { \
+        CHECK(TOKENPASTE2(name, _Write)(&ring, next) == 0); \
+        next++; \
+      } \
+      if (fill == (capacity)) { \
+        CHECK(TOKENPASTE2(name, _Space)(&ring) == 0); \
+        CHECK(TOKENPASTE2(name, _Write)(&ring, 0xDEADBEEF) == -1); \
+      } \
+      CHECK(TOKENPASTE2(name, _Count)(&ring) + TOKENPASTE2(name, _Space)(&ring) == (capacity)); \
+      while (TOKENPASTE2(name, _Count)(&ring) > keep) { \
+        CHECK(TOKENPASTE2(name, _Read)(&ring, &value) == 0); \
+        CHECK(value == expected); \
+        expected = value + 1; \
+      } \
+    } \
+    while (TOKENPASTE2(name, _Read)(&ring, &value) == 0) { \
+      CHECK(value == expected); \
+      expected = value + 1; \
+    } \
+    CHECK(expected == next); \
+    CHECK(TOKENPASTE2(name, _Count)(&ring) == 0); \
+  } while (0)
+
+static int Run(const char *name, void (*test)(void)) {
+  Failures = 0;
+  test();
+  printf("%s %s: %u failures\n", Failures ? "FAIL" : "PASS", name, Failures);
+  return Failures ? 1 : 0;
+}
+
+static void TestIndex8(void) {
+  SWEEP(Ring8x1, 1, 1000);
+  SWEEP(Ring8x8, 8, 10000);
+  SWEEP(Ring8x128, 128, 100000);
+}
+
+static void TestIndex16(void) {
+  SWEEP(Ring16x16, 16, 300000);
+  SWEEP(Ring16x32768, 32768, 300000);
+}
+
+static Ring8x8_TypeDef raceRing;
+
+static void *Producer(void *arg) {
+  (void)arg;
+
+  for (uint32_t value = 0; value < ITERATIONS; ) {
+    if (Ring8x8_Write(&raceRing, value)) {
+      sched_yield();
+      continue;
+    }
+    value++;
+  }
+
+  return NULL;
+}
+
+static void *Consumer(void *arg) {
+  uint32_t value;
+  (void)arg;
+
+  for (uint32_t expected = 0; expected < ITERATIONS; ) {
+    if (Ring8x8_Read(&raceRing, &value)) {
+      sched_yield();
+      continue;
+    }
+
+    if (value != expected && Failures++ < 10) {
+      printf("  expected %u got %u\n", expected, value);
+    }
+    expected = value + 1;
+  }
+
+  return NULL;
+}
+
+static void TestRace(void) {
+  pthread_t producer, consumer;
+
+  Ring8x8_Init(&raceRing);
+
+  pthread_create(&consumer, NULL, Consumer, NULL);
+  pthread_create(&producer, NULL, Producer, NULL);
+  pthread_join(producer, NULL);
+  pthread_join(consumer, NULL);
+
+  CHECK(Ring8x8_Count(&raceRing) == 0);
+}
+
+int main(void) {
+  int failed = 0;
+
+  failed |= Run("uint8_t positions", TestIndex8);
+  failed |= Run("uint16_t positions", TestIndex16);
+  failed |= Run("uint8_t positions race", TestRace);
+
+  return failed;
+}
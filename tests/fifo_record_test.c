@@ -0,0 +1,311 @@
+/**
+ * @file fifo_record_test.c
+ * @author Matthew Philyaw (matthew.philyaw@gmail.com)
+ *
+ * @brief Host side test for the variable length record FIFO
+ *
+ * The edge cases are walked through by hand first: a frame that doesn't fit
+ * the tail leaves a pad marker and starts at index 0, a frame that exactly
+ * fills the tail doesn't, Reserve/Commit with a shorter commit and the
+ * rejected calls. Then a long run of odd length frames is pushed through a
+ * small ring so the pad marker wrap happens at every tail size, checking
+ * every frame comes back whole, in order and word aligned.
+ *
+ * Last a producer and a consumer thread race, the producer stamps each frame
+ * with a sequence number and a length derived from it and the consumer
+ * checks both, so a torn, lost or duplicated frame fails the test.
+ *
+ * Build and run from the repository root:
+ * @code
+ * gcc -std=gnu11 -O2 -Wall -DSTM32F446xx \
+ *   -Iinclude -Isystem/include -Isystem/include/cmsis -Isystem/include/cmsis/device \
+ *   src/FIFO_Record.c tests/fifo_record_test.c -lpthread -o fifo_record_test && ./fifo_record_test
+ * @endcode
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include "FIFO_Record.h"
+
+#define ITERATIONS 1000000UL
+#define MAX_FRAME 29
+
+static uint32_t Failures;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond) && Failures++ < 10) { \
+      printf("  line %d: %s\n", __LINE__, #cond); \
+    } \
+  } while (0)
+
+static int Run(const char *name, void (*test)(void)) {
+  Failures = 0;
+  test();
+  printf("%s %s: %u failures\n", Failures ? "FAIL" : "PASS", name, Failures);
+  return Failures ? 1 : 0;
+}
+
+/**
+ * @brief Length of the frame carrying sequence number seq, odd and even, 0 to MAX_FRAME
+ */
+static uint32_t FrameLength(uint32_t seq) {
+  return (seq * 7) % (MAX_FRAME + 1);
+}
+
+/**
+ * @brief Fill a frame with bytes derived from its sequence number
+ */
+static void FillFrame(uint8_t *frame, uint32_t seq, uint32_t length) {
+  for (uint32_t i = 0; i < length; i++) {
+    frame[i] = (uint8_t)(seq + i);
+  }
+}
+
+/**
+ * @brief Check a frame holds what FillFrame put in for seq
+ */
+static uint_fast8_t FrameMatches(const uint8_t *frame, uint32_t seq, uint32_t length) {
+  for (uint32_t i = 0; i < length; i++) {
+    if (frame[i] != (uint8_t)(seq + i)) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+static void TestWrap(void) {
+  static uint32_t storage[16]; // 64 bytes
+  FIFORecordContext_TypeDef ctx;
+  uint8_t data[64];
+  const void *frame;
+  uint32_t length;
+  void *region;
+
+  CHECK(FIFO_Record_Init(&ctx, 62, storage) == -1);
+  CHECK(FIFO_Record_Init(&ctx, 64, (uint8_t *)storage + 1) == -1);
+  CHECK(FIFO_Record_Init(&ctx, sizeof(storage), storage) == 0);
+  CHECK(FIFO_Record_Peek(&ctx, &frame, &length) == -1);
+  CHECK(FIFO_Record_Release(&ctx) == -1);
+
+  FillFrame(data, 0, sizeof(data));
+
+  // 13 + 21 + 3 bytes take 20 + 28 + 8 = 56 of 64, leaving an 8 byte tail
+  CHECK(FIFO_Record_Write(&ctx, data, 13) == 0);
+  CHECK(FIFO_Record_Write(&ctx, data, 21) == 0);
+  CHECK(FIFO_Record_Write(&ctx, data, 3) == 0);
+  CHECK(FIFO_Record_Used(&ctx) == 56);
+
+  // 5 bytes need 12, only 8 are left at the end and nothing at the start
+  CHECK(FIFO_Record_Reserve(&ctx, 5, &region) == -1);
+  CHECK(FIFO_Record_Dropped(&ctx) == 1);
+
+  CHECK(FIFO_Record_Peek(&ctx, &frame, &length) == 0);
+  CHECK(length == 13 && frame == (uint8_t *)storage + FIFO_RECORD_HEADER);
+  CHECK(FrameMatches(frame, 0, length));
+  CHECK(FIFO_Record_Release(&ctx) == 0);
+
+  // now it fits at index 0, the tail gets a pad marker
+  CHECK(FIFO_Record_Reserve(&ctx, 5, &region) == 0);
+  CHECK(region == (uint8_t *)storage + FIFO_RECORD_HEADER);
+  FillFrame(region, 100, 5);
+  CHECK(FIFO_Record_Commit(&ctx, 5) == 0);
+  CHECK(FIFO_Record_Used(&ctx) == 36 + 8 + 12);
+
+  CHECK(FIFO_Record_Peek(&ctx, &frame, &length) == 0);
+  CHECK(length == 21 && FrameMatches(frame, 0, length));
+  CHECK(FIFO_Record_Release(&ctx) == 0);
+  CHECK(FIFO_Record_Peek(&ctx, &frame, &length) == 0);
+  CHECK(length == 3 && FrameMatches(frame, 0, length));
+  CHECK(FIFO_Record_Release(&ctx) == 0);
+
+  // the reader steps over the pad to the frame at index 0
+  CHECK(FIFO_Record_Peek(&ctx, &frame, &length) == 0);
+  CHECK(length == 5 && frame == (uint8_t *)storage + FIFO_RECORD_HEADER);
+  CHECK(FrameMatches(frame, 100, length));
+  CHECK(FIFO_Record_Release(&ctx) == 0);
+  CHECK(FIFO_Record_Used(&ctx) == 0);
+  CHECK(FIFO_Record_Peek(&ctx, &frame, &length) == -1);
+
+  // a frame that exactly fills the tail needs no pad, the next one starts at 0
+  CHECK(FIFO_Record_Write(&ctx, data, 52 - FIFO_RECORD_HEADER) == 0);
+  CHECK(FIFO_Record_Peek(&ctx, &frame, &length) == 0);
+  CHECK(frame == (uint8_t *)storage + 12 + FIFO_RECORD_HEADER);
+  CHECK(FIFO_Record_Release(&ctx) == 0);
+  CHECK(FIFO_Record_Reserve(&ctx, 1, &region) == 0);
+  CHECK(region == (uint8_t *)storage + FIFO_RECORD_HEADER);
+}
+
+static void TestReserveCommit(void) {
+  static uint32_t storage[16];
+  FIFORecordContext_TypeDef ctx;
+  const void *frame;
+  uint32_t length;
+  void *region;
+
+  CHECK(FIFO_Record_Init(&ctx, sizeof(storage), storage) == 0);
+
+  // nothing reserved yet
+  CHECK(FIFO_Record_Commit(&ctx, 0) == -1);
+
+  // larger than the whole buffer can ever hold
+  CHECK(FIFO_Record_Reserve(&ctx, sizeof(storage) - FIFO_RECORD_HEADER + 1, &region) == -1);
+  CHECK(FIFO_Record_Dropped(&ctx) == 1);
+
+  // reserve for the largest frame, commit what actually came in
+  CHECK(FIFO_Record_Reserve(&ctx, 32, &region) == 0);
+  CHECK(FIFO_Record_Used(&ctx) == 0);
+  CHECK(FIFO_Record_Peek(&ctx, &frame, &length) == -1);
+  CHECK(FIFO_Record_Commit(&ctx, 33) == -1);
+  FillFrame(region, 7, 9);
+  CHECK(FIFO_Record_Commit(&ctx, 9) == 0);
+  CHECK(FIFO_Record_Used(&ctx) == FIFO_RECORD_SIZE(9));
+
+  // the reservation is gone once committed
+  CHECK(FIFO_Record_Commit(&ctx, 0) == -1);
+
+  // reserving again replaces an uncommitted reservation
+  CHECK(FIFO_Record_Reserve(&ctx, 40, &region) == 0);
+  CHECK(FIFO_Record_Reserve(&ctx, 2, &region) == 0);
+  CHECK(FIFO_Record_Commit(&ctx, 3) == -1);
+  FillFrame(region, 9, 2);
+  CHECK(FIFO_Record_Commit(&ctx, 2) == 0);
+
+  CHECK(FIFO_Record_Peek(&ctx, &frame, &length) == 0);
+  CHECK(length == 9 && FrameMatches(frame, 7, length));
+  CHECK(FIFO_Record_Release(&ctx) == 0);
+  CHECK(FIFO_Record_Peek(&ctx, &frame, &length) == 0);
+  CHECK(length == 2 && FrameMatches(frame, 9, length));
+  CHECK(((uintptr_t)frame & 3U) == 0);
+  CHECK(FIFO_Record_Release(&ctx) == 0);
+
+  // a zero length frame still takes a header
+  CHECK(FIFO_Record_Write(&ctx, NULL, 0) == 0);
+  CHECK(FIFO_Record_Used(&ctx) == FIFO_RECORD_HEADER);
+  CHECK(FIFO_Record_Peek(&ctx, &frame, &length) == 0);
+  CHECK(length == 0);
+  CHECK(FIFO_Record_Release(&ctx) == 0);
+}
+
+static void TestSequence(void) {
+  static uint32_t storage[24]; // 96 bytes, not a power of two
+  FIFORecordContext_TypeDef ctx;
+  const void *frame;
+  uint32_t length;
+  void *region;
+  uint32_t written = 0;
+  uint32_t read = 0;
+  uint32_t pads = 0;
+
+  CHECK(FIFO_Record_Init(&ctx, sizeof(storage), storage) == 0);
+
+  // keep a varying backlog so the write position meets the end at every offset
+  while (read < 20000) {
+    while (written - read < (written % 5) + 1) {
+      uint32_t writeIndex = ctx.WritePos % sizeof(storage);
+
+      if (FIFO_Record_Reserve(&ctx, FrameLength(written), &region)) {
+        break;
+      }
+
+      CHECK(((uintptr_t)region & 3U) == 0);
+      if ((uint8_t *)region == (uint8_t *)storage + FIFO_RECORD_HEADER && writeIndex != 0) {
+        pads++;
+      }
+
+      FillFrame(region, written, FrameLength(written));
+      CHECK(FIFO_Record_Commit(&ctx, FrameLength(written)) == 0);
+      written++;
+    }
+
+    CHECK(FIFO_Record_Used(&ctx) <= sizeof(storage));
+
+    if (FIFO_Record_Peek(&ctx, &frame, &length)) {
+      CHECK(written == read);
+      continue;
+    }
+
+    CHECK(((uintptr_t)frame & 3U) == 0);
+    CHECK(length == FrameLength(read));
+    CHECK(FrameMatches(frame, read, length));
+    CHECK((const uint8_t *)frame + length <= (const uint8_t *)storage + sizeof(storage));
+    CHECK(FIFO_Record_Release(&ctx) == 0);
+    read++;
+  }
+
+  CHECK(pads > 100);
+  CHECK(FIFO_Record_Dropped(&ctx) > 0);
+}
+
+static uint32_t raceStorage[32];
+static FIFORecordContext_TypeDef raceFifo;
+
+static void *Producer(void *arg) {
+  uint8_t frame[MAX_FRAME + 4];
+  (void)arg;
+
+  for (uint32_t seq = 0; seq < ITERATIONS; ) {
+    uint32_t length = FrameLength(seq) + 4;
+
+    memcpy(frame, &seq, sizeof(seq));
+    FillFrame(frame + 4, seq, length - 4);
+
+    if (FIFO_Record_Write(&raceFifo, frame, length)) {
+      sched_yield();
+      continue;
+    }
+    seq++;
+  }
+
+  return NULL;
+}
+
+static void *Consumer(void *arg) {
+  const void *frame;
+  uint32_t length;
+  (void)arg;
+
+  for (uint32_t expected = 0; expected < ITERATIONS; ) {
+    if (FIFO_Record_Peek(&raceFifo, &frame, &length)) {
+      sched_yield();
+      continue;
+    }
+
+    uint32_t seq;
+    memcpy(&seq, frame, sizeof(seq));
+
+    if ((seq != expected || length != FrameLength(seq) + 4 || !FrameMatches((const uint8_t *)frame + 4, seq, length - 4)) &&
+        Failures++ < 10) {
+      printf("  expected %u got %u length %u\n", expected, seq, length);
+    }
+
+    FIFO_Record_Release(&raceFifo);
+    expected = seq + 1;
+  }
+
+  return NULL;
+}
+
+static void TestRace(void) {
+  pthread_t producer, consumer;
+
+  CHECK(FIFO_Record_Init(&raceFifo, sizeof(raceStorage), raceStorage) == 0);
+
+  pthread_create(&consumer, NULL, Consumer, NULL);
+  pthread_create(&producer, NULL, Producer, NULL);
+  pthread_join(producer, NULL);
+  pthread_join(consumer, NULL);
+
+  CHECK(FIFO_Record_Used(&raceFifo) == 0);
+}
+
+int main(void) {
+  int failed = 0;
+
+  failed |= Run("pad marker wrap", TestWrap);
+  failed |= Run("reserve commit", TestReserveCommit);
+  failed |= Run("odd length sequence", TestSequence);
+  failed |= Run("producer consumer race", TestRace);
+
+  return failed;
+}
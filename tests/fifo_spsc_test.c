@@ -0,0 +1,257 @@
+/**
+ * @file fifo_spsc_test.c
+ * @author Matthew Philyaw (matthew.philyaw@gmail.com)
+ *
+ * @brief Host side stress test for the single producer/single consumer FIFO
+ *
+ * A producer thread plays the part of USART3_IRQHandler and a consumer thread
+ * the part of GetByte. The producer writes an incrementing sequence and the
+ * consumer checks every value it reads is exactly the next one expected, so a
+ * lost or duplicated element fails the test. Each size is run once with the
+ * per element calls and once with the FIFO_WriteN/FIFO_ReadN block calls.
+ *
+ * The overwrite-oldest policy is checked separately: the consumer must see a
+ * strictly increasing sequence and what it read plus FIFO_Dropped must add
+ * up to everything written.
+ *
+ * A byte ring is run the same way with FIFO_WriteByte, the in place store the
+ * USART receive ISR uses, and the low 8 bits of the sequence.
+ *
+ * Build and run from the repository root:
+ * @code
+ * gcc -std=gnu11 -O2 -Wall -DSTM32F446xx -DFIFO_UINT32_T \
+ *   -Iinclude -Isystem/include -Isystem/include/cmsis -Isystem/include/cmsis/device \
+ *   src/FIFO.c tests/fifo_spsc_test.c -lpthread -o fifo_spsc_test && ./fifo_spsc_test
+ * @endcode
+ */
+#include <pthread.h>
+#include <sched.h>
+#include "FIFO.h"
+
+#define ITERATIONS 2000000UL
+#define CHUNK 13
+
+typedef struct {
+  FIFOContext_TypeDef Fifo;
+  uint_fast8_t Bulk;
+  volatile uint_fast8_t Done;
+  uint32_t Received;
+  uint32_t Failures;
+} TestContext;
+
+static void *Producer(void *arg) {
+  TestContext *test = arg;
+  uint32_t chunk[CHUNK];
+
+  for (uint32_t value = 0; value < ITERATIONS; ) {
+    if (test->Bulk) {
+      uint32_t length = (ITERATIONS - value < CHUNK) ? ITERATIONS - value : CHUNK;
+
+      for (uint32_t i = 0; i < length; i++) {
+        chunk[i] = value + i;
+      }
+
+      uint32_t written = FIFO_WriteN(&test->Fifo, chunk, length);
+      if (!written) {
+        sched_yield();
+      }
+      value += written;
+      continue;
+    }
+
+    if (FIFO_Write_uint32_t(test->Fifo, value)) {
+      sched_yield();
+      continue;
+    }
+    value++;
+  }
+
+  return NULL;
+}
+
+static void Check(TestContext *test, uint32_t *expected, uint32_t value) {
+  if (value != *expected) {
+    if (test->Failures++ < 10) {
+      printf("  expected %u got %u\n", *expected, value);
+    }
+    *expected = value;
+  }
+  (*expected)++;
+}
+
+static void *Consumer(void *arg) {
+  TestContext *test = arg;
+  uint32_t chunk[CHUNK];
+  uint32_t value;
+
+  for (uint32_t expected = 0; expected < ITERATIONS; ) {
+    if (test->Bulk) {
+      uint32_t read = FIFO_ReadN(&test->Fifo, chunk, CHUNK);
+      if (!read) {
+        sched_yield();
+      }
+      for (uint32_t i = 0; i < read; i++) {
+        Check(test, &expected, chunk[i]);
+      }
+      continue;
+    }
+
+    if (FIFO_Read_uint32_t(test->Fifo, value)) {
+      sched_yield();
+      continue;
+    }
+
+    Check(test, &expected, value);
+  }
+
+  return NULL;
+}
+
+static int RunCase(uint32_t maxSize, uint_fast8_t bulk) {
+  uint32_t buffer[maxSize];
+  TestContext test = { .Bulk = bulk, .Failures = 0 };
+  pthread_t producer, consumer;
+
+  FIFO_Init_uint32_t(test.Fifo, maxSize, buffer);
+
+  pthread_create(&consumer, NULL, Consumer, &test);
+  pthread_create(&producer, NULL, Producer, &test);
+  pthread_join(producer, NULL);
+  pthread_join(consumer, NULL);
+
+  if (FIFO_Count(&test.Fifo) != 0) {
+    test.Failures++;
+  }
+
+  printf("%s size %u%s: %u failures\n", test.Failures ? "FAIL" : "PASS", maxSize, bulk ? " bulk" : "", test.Failures);
+  return test.Failures ? 1 : 0;
+}
+
+static void *OverwriteProducer(void *arg) {
+  TestContext *test = arg;
+
+  for (uint32_t value = 0; value < ITERATIONS; value++) {
+    FIFO_Write_uint32_t(test->Fifo, value);
+  }
+
+  test->Done = TRUE;
+  return NULL;
+}
+
+static void *OverwriteConsumer(void *arg) {
+  TestContext *test = arg;
+  uint32_t value;
+  uint32_t last = 0;
+
+  for (;;) {
+    uint_fast8_t done = test->Done;
+
+    if (FIFO_Read_uint32_t(test->Fifo, value)) {
+      if (done) {
+        break;
+      }
+      continue;
+    }
+
+    if (test->Received && value <= last && test->Failures++ < 10) {
+      printf("  %u after %u\n", value, last);
+    }
+
+    last = value;
+    test->Received++;
+  }
+
+  return NULL;
+}
+
+static int RunOverwriteCase(uint32_t maxSize) {
+  uint32_t buffer[maxSize];
+  TestContext test = { .Failures = 0 };
+  pthread_t producer, consumer;
+
+  FIFO_Init_uint32_t(test.Fifo, maxSize, buffer);
+  FIFO_SetOverflowPolicy(&test.Fifo, FIFO_OVERFLOW_OVERWRITE_OLDEST, NULL);
+
+  pthread_create(&consumer, NULL, OverwriteConsumer, &test);
+  pthread_create(&producer, NULL, OverwriteProducer, &test);
+  pthread_join(producer, NULL);
+  pthread_join(consumer, NULL);
+
+  if (test.Received + FIFO_Dropped(&test.Fifo) != ITERATIONS) {
+    printf("  received %u + dropped %u\n", test.Received, FIFO_Dropped(&test.Fifo));
+    test.Failures++;
+  }
+
+  printf("%s size %u overwrite: %u failures\n", test.Failures ? "FAIL" : "PASS", maxSize, test.Failures);
+  return test.Failures ? 1 : 0;
+}
+
+static void *ByteProducer(void *arg) {
+  TestContext *test = arg;
+
+  for (uint32_t value = 0; value < ITERATIONS; ) {
+    if (FIFO_WriteByte(&test->Fifo, (uint8_t)value)) {
+      sched_yield();
+      continue;
+    }
+    value++;
+  }
+
+  return NULL;
+}
+
+static void *ByteConsumer(void *arg) {
+  TestContext *test = arg;
+  uint8_t chunk[CHUNK];
+
+  for (uint32_t expected = 0; expected < ITERATIONS; ) {
+    uint32_t read = FIFO_ReadN(&test->Fifo, chunk, CHUNK);
+
+    if (!read) {
+      sched_yield();
+    }
+
+    for (uint32_t i = 0; i < read; i++, expected++) {
+      if (chunk[i] != (uint8_t)expected && test->Failures++ < 10) {
+        printf("  expected %u got %u\n", (uint8_t)expected, chunk[i]);
+      }
+    }
+  }
+
+  return NULL;
+}
+
+static int RunByteCase(uint32_t maxSize) {
+  uint8_t buffer[maxSize];
+  TestContext test = { .Failures = 0 };
+  pthread_t producer, consumer;
+
+  FIFO_Init(&test.Fifo, maxSize, sizeof(uint8_t), buffer);
+
+  pthread_create(&consumer, NULL, ByteConsumer, &test);
+  pthread_create(&producer, NULL, ByteProducer, &test);
+  pthread_join(producer, NULL);
+  pthread_join(consumer, NULL);
+
+  if (FIFO_Count(&test.Fifo) != 0) {
+    test.Failures++;
+  }
+
+  printf("%s size %u byte: %u failures\n", test.Failures ? "FAIL" : "PASS", maxSize, test.Failures);
+  return test.Failures ? 1 : 0;
+}
+
+int main(void) {
+  // odd and tiny sizes wrap constantly and hit the full/empty edges
+  const uint32_t sizes[] = { 1, 2, 7, 20, 256 };
+  int failed = 0;
+
+  for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    failed |= RunCase(sizes[i], FALSE);
+    failed |= RunCase(sizes[i], TRUE);
+    failed |= RunOverwriteCase(sizes[i]);
+    failed |= RunByteCase(sizes[i]);
+  }
+
+  return failed;
+}
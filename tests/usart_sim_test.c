@@ -0,0 +1,1548 @@
+/**
+ * @file usart_sim_test.c
+ * @author Matthew Philyaw (matthew.philyaw@gmail.com)
+ *
+ * @brief Host side test of the USART driver against simulated registers
+ *
+ * usart.c and serial_ports.c are compiled straight into this file with only
+ * SerialPort3 and SerialPort6 enabled, and their USARTs, DMA controllers and
+ * streams, RCC, the GPIO ports and the NVIC calls swapped for plain structs
+ * in RAM.
+ * The simulated DMA streams behave like the real ones in the parts the driver
+ * relies on: RX writes at M0AR + (length - NDTR), counts NDTR down, reloads
+ * it in circular mode and raises half transfer and transfer complete. TX
+ * moves NDTR bytes from M0AR onto a simulated line, clears EN and raises
+ * transfer complete. The simulated USART shifts a byte out the moment it is
+ * written to DR. The tests feed bytes in and check what comes out of
+ * GetByte, or send and check what reaches the line.
+ *
+ * Build and run from the repository root:
+ * @code
+ * gcc -std=gnu11 -O2 -Wall -DSTM32F446xx \
+ *   -Iinclude -Isystem/include -Isystem/include/cmsis -Isystem/include/cmsis/device \
+ *   src/FIFO.c src/FIFO_MPSC.c src/FIFO_Broadcast.c tests/usart_sim_test.c -o usart_sim_test && ./usart_sim_test
+ * @endcode
+ */
+#include <string.h>
+#include "common.h"
+
+#undef EN_SERIAL_PORT1
+#undef EN_SERIAL_PORT2
+#undef EN_SERIAL_PORT4
+#undef EN_SERIAL_PORT5
+
+/**********************************************************************
+*                        Simulated peripherals                       *
+**********************************************************************/
+
+static USART_TypeDef SimUsart3;
+static USART_TypeDef SimUsart6;
+static DMA_TypeDef SimDma1;
+static DMA_TypeDef SimDma2;
+static DMA_Stream_TypeDef SimDma1Stream1;
+static DMA_Stream_TypeDef SimDma1Stream3;
+static DMA_Stream_TypeDef SimDma2Stream1;
+static DMA_Stream_TypeDef SimDma2Stream6;
+static RCC_TypeDef SimRcc;
+static GPIO_TypeDef SimGpioC;
+static GPIO_TypeDef SimGpioD;
+static DWT_Type SimDwt;
+static CoreDebug_Type SimCoreDebug;
+static uint32_t SimTickMs;
+static uint32_t SimIpsr; // exception number the caller runs in, 0 is thread mode
+static uint8_t SimNvicEnabled[128];
+
+uint32_t SystemCoreClock = 16000000;
+
+#undef USART3
+#undef USART6
+#undef DMA1
+#undef DMA2
+#undef DMA1_Stream1
+#undef DMA1_Stream3
+#undef DMA2_Stream1
+#undef DMA2_Stream6
+#undef RCC
+#undef GPIOC
+#undef GPIOD
+#define USART3 (&SimUsart3)
+#define USART6 (&SimUsart6)
+#define DMA1 (&SimDma1)
+#define DMA2 (&SimDma2)
+#define DMA1_Stream1 (&SimDma1Stream1)
+#define DMA1_Stream3 (&SimDma1Stream3)
+#define DMA2_Stream1 (&SimDma2Stream1)
+#define DMA2_Stream6 (&SimDma2Stream6)
+#define RCC (&SimRcc)
+#define GPIOC (&SimGpioC)
+#define GPIOD (&SimGpioD)
+#undef DWT
+#undef CoreDebug
+#define DWT (SimDwtRead())
+#define CoreDebug (&SimCoreDebug)
+
+#define NVIC_EnableIRQ(irq) (SimNvicEnabled[irq] = TRUE)
+#define NVIC_DisableIRQ(irq) (SimNvicEnabled[irq] = FALSE)
+#define NVIC_SetPriority(irq, priority) ((void)(irq), (void)(priority))
+#define NVIC_SetPendingIRQ(irq) SimNvicPend(irq)
+#define SystemCoreClockUpdate() ((void)0) // SystemCoreClock is set by the tests
+#define __get_PRIMASK() 0U
+#define __get_IPSR() SimIpsr
+#define __set_PRIMASK(primask) ((void)(primask))
+#define __disable_irq() ((void)0)
+
+/**
+ * @brief Waveform driven onto PD9 (USART3 RX) while SimRxWaveBits is set
+ *
+ * One level per bit time starting SimRxWaveStart cycles after CYCCNT 0, the
+ * line idles high before and after. Polling it, through DWT or Tick_GetMs,
+ * moves time on by SIM_RX_WAVE_POLL cycles.
+ */
+#define SIM_RX_WAVE_POLL 7
+static const uint8_t *SimRxWave;
+static uint32_t SimRxWaveBits;
+static uint32_t SimRxWaveStart;
+static uint32_t SimRxWaveBaudrate;
+
+static void SimRxWaveAdvance(void) {
+  if (!SimRxWaveBits) {
+    return;
+  }
+
+  SimDwt.CYCCNT += SIM_RX_WAVE_POLL;
+
+  uint32_t level = 1;
+
+  if (SimDwt.CYCCNT >= SimRxWaveStart) {
+    uint64_t bit = ((uint64_t)(SimDwt.CYCCNT - SimRxWaveStart) * SimRxWaveBaudrate) / SystemCoreClock;
+
+    if (bit < SimRxWaveBits) {
+      level = SimRxWave[bit];
+    }
+  }
+
+  SimGpioD.IDR = level ? (SimGpioD.IDR | GPIO_IDR_IDR_9) : (SimGpioD.IDR & ~GPIO_IDR_IDR_9);
+}
+
+static DWT_Type *SimDwtRead(void) {
+  SimRxWaveAdvance();
+  return &SimDwt;
+}
+
+/**
+ * @brief Every call is a millisecond later
+ */
+uint32_t Tick_GetMs(void) {
+  SimRxWaveAdvance();
+  return SimTickMs++;
+}
+
+static void SimNvicPend(IRQn_Type irq);
+
+#include "../src/MCU/usart.c"
+#include "../src/MCU/serial_ports.c"
+
+/**
+ * @brief Ring storage handed to SerialPort3, SerialPort6 gets its own smaller rings
+ */
+#define RX_SIZE 32
+#define TX_SIZE 128
+#define PORT6_RX_SIZE 8
+#define PORT6_TX_SIZE 16
+
+static SERIAL_BUFFER(rxStorage3, RX_SIZE);
+static SERIAL_BUFFER(txStorage3, SERIAL_TX_STORAGE_SIZE(TX_SIZE));
+static SERIAL_BUFFER(rxStorage6, PORT6_RX_SIZE);
+static SERIAL_BUFFER_IN(txStorage6, SERIAL_TX_STORAGE_SIZE(PORT6_TX_SIZE), ".data.serial");
+
+/**
+ * @brief Bytes the simulated TX DMA put on the line
+ */
+static uint8_t SimLine[4096];
+static uint32_t SimLineLength;
+
+/**
+ * @brief A pended interrupt runs right away, the caller is always thread mode
+ */
+static void SimNvicPend(IRQn_Type irq) {
+  if (!SimNvicEnabled[irq]) {
+    return;
+  }
+
+  if (irq == DMA1_Stream3_IRQn) {
+    DMA1_Stream3_IRQHandler();
+  }
+  else if (irq == USART3_IRQn) {
+    USART3_IRQHandler();
+  }
+  else if (irq == DMA2_Stream6_IRQn) {
+    DMA2_Stream6_IRQHandler();
+  }
+}
+
+/**
+ * @brief Finish the running TX DMA transfer
+ *
+ * @return number of bytes the transfer moved, 0 if none was running
+ */
+static uint32_t SimDmaTransmit(void) {
+  uint32_t length = SimDma1Stream3.NDTR;
+
+  if (!(SimDma1Stream3.CR & DMA_SxCR_EN) || !(SimUsart3.CR3 & USART_CR3_DMAT)) {
+    return 0;
+  }
+
+  // M0AR only holds the low half of a host pointer, it is always into txStorage3
+  const uint8_t *source = txStorage3 + (SimDma1Stream3.M0AR - (uint32_t)(uintptr_t)txStorage3);
+
+  for (uint32_t i = 0; i < length; i++) {
+    SimLine[SimLineLength++] = source[i];
+  }
+
+  SimDma1Stream3.NDTR = 0;
+  SimDma1Stream3.CR &= ~DMA_SxCR_EN;
+  SimDma1.LISR |= DMA_LISR_TCIF3;
+
+  if ((SimDma1Stream3.CR & DMA_SxCR_TCIE) && SimNvicEnabled[DMA1_Stream3_IRQn]) {
+    DMA1_Stream3_IRQHandler();
+  }
+
+  SimDma1.LISR &= ~SimDma1.LIFCR;
+  SimDma1.LIFCR = 0;
+
+  return length;
+}
+
+/**
+ * @brief Raise a DMA1 low flag and run the stream 1 ISR if it is unmasked
+ */
+static void SimDmaStream1Flag(uint32_t flag, uint32_t enable) {
+  SimDma1.LISR |= flag;
+
+  if ((SimDma1Stream1.CR & enable) && SimNvicEnabled[DMA1_Stream1_IRQn]) {
+    DMA1_Stream1_IRQHandler();
+  }
+
+  // LIFCR is write one to clear
+  SimDma1.LISR &= ~SimDma1.LIFCR;
+  SimDma1.LIFCR = 0;
+}
+
+/**
+ * @brief Receive bytes the way DMA1 Stream1 would with DMAR set
+ */
+static void SimDmaReceive(const uint8_t *data, uint32_t length) {
+  for (uint32_t i = 0; i < length; i++) {
+    if (!(SimDma1Stream1.CR & DMA_SxCR_EN) || !(SimUsart3.CR3 & USART_CR3_DMAR)) {
+      return;
+    }
+
+    rxStorage3[RX_SIZE - SimDma1Stream1.NDTR] = data[i];
+    SimDma1Stream1.NDTR--;
+
+    if (SimDma1Stream1.NDTR == RX_SIZE / 2) {
+      SimDmaStream1Flag(DMA_LISR_HTIF1, DMA_SxCR_HTIE);
+    }
+
+    if (SimDma1Stream1.NDTR == 0) {
+      if (SimDma1Stream1.CR & DMA_SxCR_CIRC) {
+        SimDma1Stream1.NDTR = RX_SIZE;
+      }
+      else {
+        SimDma1Stream1.CR &= ~DMA_SxCR_EN;
+      }
+
+      SimDmaStream1Flag(DMA_LISR_TCIF1, DMA_SxCR_TCIE);
+    }
+  }
+}
+
+/**
+ * @brief Run USART3_IRQHandler for the given status flags if they are unmasked
+ */
+static void SimUsartInterrupt(uint32_t sr, uint32_t enable) {
+  SimUsart3.SR |= sr;
+
+  if ((SimUsart3.CR1 & enable) && SimNvicEnabled[USART3_IRQn]) {
+    USART3_IRQHandler();
+  }
+
+  // cleared by the SR then DR read in the ISR
+  SimUsart3.SR &= ~sr;
+}
+
+/**
+ * @brief DR value meaning nothing was written to it
+ */
+#define SIM_DR_EMPTY 0xFFFFFFFFU
+
+/**
+ * @brief Run the TXE/TC interrupts until the driver stops asking for them
+ *
+ * @return number of bytes the driver wrote to DR
+ */
+static uint32_t SimUsartTransmit(void) {
+  uint32_t sent = 0;
+
+  while (SimUsart3.CR1 & (USART_CR1_TXEIE | USART_CR1_TCIE)) {
+    SimUsart3.DR = SIM_DR_EMPTY;
+    SimUsartInterrupt(USART_SR_TXE | USART_SR_TC, USART_CR1_TXEIE | USART_CR1_TCIE);
+
+    if (SimUsart3.DR != SIM_DR_EMPTY) {
+      SimLine[SimLineLength++] = SimUsart3.DR;
+      sent++;
+    }
+  }
+
+  return sent;
+}
+
+/**
+ * @brief Line goes idle after a burst
+ */
+static void SimIdleLine(void) {
+  SimUsartInterrupt(USART_SR_IDLE, USART_CR1_IDLEIE);
+}
+
+/**********************************************************************
+*                                Tests                               *
+**********************************************************************/
+
+static uint32_t Failures;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      Failures++; \
+      printf("  line %d: %s\n", __LINE__, #cond); \
+    } \
+  } while (0)
+
+#define STORAGE3 rxStorage3, RX_SIZE, txStorage3, TX_SIZE
+
+static const SerialConfig_TypeDef DmaConfig = { 115200, SERIAL_RX_DMA, SERIAL_TX_BLOCKING, STORAGE3 };
+static const SerialConfig_TypeDef InterruptConfig = { 115200, SERIAL_RX_INTERRUPT, SERIAL_TX_BLOCKING, STORAGE3 };
+static const SerialConfig_TypeDef TxDmaConfig = { 115200, SERIAL_RX_INTERRUPT, SERIAL_TX_DMA, STORAGE3 };
+static const SerialConfig_TypeDef TxInterruptConfig = { 115200, SERIAL_RX_INTERRUPT, SERIAL_TX_INTERRUPT, STORAGE3 };
+static const SerialConfig_TypeDef Port6Config = {
+  115200, SERIAL_RX_DMA, SERIAL_TX_DMA,
+  rxStorage6, PORT6_RX_SIZE, txStorage6, PORT6_TX_SIZE
+};
+
+static uint32_t TxCallbacks;
+
+static void OnTxComplete(void) {
+  TxCallbacks++;
+}
+
+/**
+ * @brief Read everything published and check it continues the expected sequence
+ */
+static uint32_t Drain(uint8_t *expected) {
+  uint8_t data[RX_SIZE];
+  uint32_t total = 0;
+  int32_t numRead;
+
+  while ((numRead = SerialPort3.GetByte(data, sizeof(data))) > 0) {
+    for (int32_t i = 0; i < numRead; i++) {
+      CHECK(data[i] == *expected);
+      (*expected)++;
+    }
+    total += numRead;
+  }
+
+  return total;
+}
+
+static void TestDmaOpen(void) {
+  CHECK(SerialPort3.Open(&DmaConfig) == SERIAL_SUCCESS);
+  CHECK(SerialPort3.Open(&DmaConfig) == SERIAL_FAIL);
+
+  CHECK(SimRcc.AHB1ENR & RCC_AHB1ENR_DMA1EN);
+  CHECK(SimUsart3.CR3 & USART_CR3_DMAR);
+  CHECK(SimUsart3.CR1 & USART_CR1_IDLEIE);
+  CHECK(!(SimUsart3.CR1 & USART_CR1_RXNEIE));
+  CHECK(SimDma1Stream1.PAR == (uint32_t)(uintptr_t)&SimUsart3.DR);
+  CHECK(SimDma1Stream1.M0AR == (uint32_t)(uintptr_t)rxStorage3);
+  CHECK(SimDma1Stream1.NDTR == RX_SIZE);
+  CHECK((SimDma1Stream1.CR & DMA_SxCR_CHSEL) == DMA_SxCR_CHSEL_2);
+  CHECK((SimDma1Stream1.CR & DMA_SxCR_DIR) == 0);
+  CHECK(SimDma1Stream1.CR & DMA_SxCR_CIRC);
+  CHECK(SimDma1Stream1.CR & DMA_SxCR_MINC);
+  CHECK(SimDma1Stream1.CR & DMA_SxCR_EN);
+  CHECK(SimNvicEnabled[DMA1_Stream1_IRQn]);
+
+  // PD8/PD9 in alternate function mode on AF7
+  CHECK(((SimGpioD.MODER >> 16) & 0x0F) == 0x0A);
+  CHECK((SimGpioD.AFR[1] & 0xFF) == 0x77);
+}
+
+static void TestOpenStorage(void) {
+  SerialConfig_TypeDef config = TxDmaConfig;
+
+  config.RxBuffer = NULL;
+  CHECK(SerialPort3.Open(&config) == SERIAL_INVALID_PARAMETER);
+
+  config = TxDmaConfig;
+  config.TxBuffer = NULL;
+  CHECK(SerialPort3.Open(&config) == SERIAL_INVALID_PARAMETER);
+
+  config.TxMode = SERIAL_TX_BLOCKING;
+  CHECK(SerialPort3.Open(&config) == SERIAL_SUCCESS);
+  SerialPort3.Close();
+
+  config = TxDmaConfig;
+  config.TxSize = 100;
+  CHECK(SerialPort3.Open(&config) == SERIAL_INVALID_PARAMETER);
+  CHECK(!SerialPort3.IsOpen());
+
+  // NDTR can't hold a 64 KiB ring, interrupt mode has no such limit
+  config = DmaConfig;
+  config.RxSize = 0x10000;
+  CHECK(SerialPort3.Open(&config) == SERIAL_INVALID_PARAMETER);
+  CHECK(!SerialPort3.IsOpen());
+
+  config.RxMode = SERIAL_RX_INTERRUPT;
+  CHECK(SerialPort3.Open(&config) == SERIAL_SUCCESS);
+  SerialPort3.Close();
+}
+
+static void TestBaudPlan(void) {
+  UsartBaudPlan_TypeDef plan;
+
+  // 115200 from 45 MHz, 390.625 clocks per bit rounds to 391
+  CHECK(Usart_PlanBaud(45000000, 115200, USART_BAUD_TOLERANCE_PPM, &plan) == 0);
+  CHECK(plan.Brr == 391);
+  CHECK(!plan.Over8);
+  CHECK(plan.Baudrate == 115090);
+  CHECK(plan.ErrorPpm == 954);
+
+  // 4.5 Mbaud from 45 MHz is 10 clocks per bit, only OVER8 gets there
+  CHECK(Usart_PlanBaud(45000000, 4500000, USART_BAUD_TOLERANCE_PPM, &plan) == 0);
+  CHECK(plan.Over8);
+  CHECK(plan.Brr == ((1 << 4) | 2));
+  CHECK(plan.Baudrate == 4500000);
+  CHECK(plan.ErrorPpm == 0);
+
+  // PCLK / 16 is still OVER16
+  CHECK(Usart_PlanBaud(90000000, 5625000, USART_BAUD_TOLERANCE_PPM, &plan) == 0);
+  CHECK(!plan.Over8);
+  CHECK(plan.Brr == 16);
+
+  // 11 clocks per bit is 2.3% off 4 Mbaud
+  CHECK(Usart_PlanBaud(45000000, 4000000, USART_BAUD_TOLERANCE_PPM, &plan) == -1);
+  CHECK(Usart_PlanBaud(45000000, 4000000, 25000, &plan) == 0);
+  CHECK(plan.Baudrate == 4090909);
+
+  // faster than PCLK / 8 and slower than the 12 bit mantissa allows
+  CHECK(Usart_PlanBaud(45000000, 6000000, USART_BAUD_TOLERANCE_PPM, &plan) == -1);
+  CHECK(Usart_PlanBaud(45000000, 300, USART_BAUD_TOLERANCE_PPM, &plan) == -1);
+  CHECK(Usart_PlanBaud(45000000, 0, USART_BAUD_TOLERANCE_PPM, &plan) == -1);
+}
+
+static void TestOpenBaud(void) {
+  SerialConfig_TypeDef config = InterruptConfig;
+
+  // APB1 at HCLK / 4
+  SimRcc.CFGR = RCC_CFGR_PPRE1_2 | RCC_CFGR_PPRE1_0;
+  SystemCoreClock = 180000000;
+
+  CHECK(SerialPort3.GetBaudrate() == 0);
+  CHECK(SerialPort3.Open(&config) == SERIAL_SUCCESS);
+  CHECK(SimUsart3.BRR == 391);
+  CHECK(!(SimUsart3.CR1 & USART_CR1_OVER8));
+  CHECK(SerialPort3.GetBaudrate() == 115090);
+  SerialPort3.Close();
+
+  config.Baudrate = 5625000;
+  CHECK(SerialPort3.Open(&config) == SERIAL_SUCCESS);
+  CHECK(SimUsart3.CR1 & USART_CR1_OVER8);
+  CHECK(SimUsart3.BRR == ((1 << 4) | 0));
+  SerialPort3.Close();
+
+  config.Baudrate = 12000000;
+  CHECK(SerialPort3.Open(&config) == SERIAL_BAUD_UNREACHABLE);
+  CHECK(!SerialPort3.IsOpen());
+
+  // USART6 is on APB2, undivided here
+  config = Port6Config;
+  config.Baudrate = 11250000;
+  CHECK(SerialPort6.Open(&config) == SERIAL_SUCCESS);
+  CHECK(SerialPort6.GetBaudrate() == 11250000);
+  SerialPort6.Close();
+
+  SimRcc.CFGR = 0;
+  SystemCoreClock = 16000000;
+}
+
+/**
+ * @brief Edge times of a sync character sent at baudrate, sampled at clock
+ *
+ * @return number of edges
+ */
+static uint32_t SyncEdges(uint8_t sync, uint32_t baudrate, uint32_t clock, uint32_t jitter, uint32_t *edges) {
+  uint32_t count = 0;
+  uint32_t level = 1;
+
+  // start bit, 8 data bits LSB first, stop bit
+  for (uint32_t bit = 0; bit < 10; bit++) {
+    uint32_t next = (bit == 0) ? 0 : (bit == 9) ? 1 : (sync >> (bit - 1)) & 1;
+
+    if (next != level) {
+      edges[count] = 5000 + (uint32_t)(((uint64_t)bit * clock) / baudrate) + ((count & 1) ? jitter : 0);
+      count++;
+      level = next;
+    }
+  }
+
+  return count;
+}
+
+static void TestBaudFromEdges(void) {
+  uint32_t edges[16];
+  uint32_t baudrate = 0;
+  uint32_t count;
+
+  count = SyncEdges(0x55, 115200, 180000000, 12, edges);
+  CHECK(count == 10);
+  CHECK(Usart_BaudFromEdges(edges, count, 180000000, &baudrate) == 0);
+  CHECK(baudrate == 115200);
+
+  count = SyncEdges(0x7F, 921600, 180000000, 12, edges);
+  CHECK(count == 4);
+  CHECK(Usart_BaudFromEdges(edges, count, 180000000, &baudrate) == 0);
+  CHECK(baudrate == 921600);
+
+  // nowhere near a standard rate, the measurement is used as is
+  count = SyncEdges(0x55, 250000, 180000000, 0, edges);
+  CHECK(Usart_BaudFromEdges(edges, count, 180000000, &baudrate) == 0);
+  CHECK(baudrate == 250000);
+
+  // the counter wrapping mid character is fine
+  count = SyncEdges(0x55, 9600, 180000000, 0, edges);
+  for (uint32_t i = 0; i < count; i++) {
+    edges[i] -= 20000;
+  }
+  CHECK(Usart_BaudFromEdges(edges, count, 180000000, &baudrate) == 0);
+  CHECK(baudrate == 9600);
+
+  // other characters have edges off the sync pattern
+  count = SyncEdges(0x77, 115200, 180000000, 0, edges);
+  CHECK(Usart_BaudFromEdges(edges, count, 180000000, &baudrate) == -1);
+  count = SyncEdges(0x3F, 115200, 180000000, 0, edges);
+  CHECK(count == 4);
+  CHECK(Usart_BaudFromEdges(edges, count, 180000000, &baudrate) == -1);
+  CHECK(Usart_BaudFromEdges(edges, 0, 180000000, &baudrate) == -1);
+}
+
+/**
+ * @brief Run DetectBaudrate on characters sent back to back at baudrate
+ */
+static SerialResult_t SimDetect(const char *characters, uint32_t baudrate, uint32_t *measured) {
+  uint8_t wave[64];
+  uint32_t bits = 0;
+  uint32_t clock = SystemCoreClock;
+
+  // start bit, 8 data bits LSB first, stop bit
+  for (const char *c = characters; *c; c++) {
+    wave[bits++] = 0;
+    for (uint32_t i = 0; i < 8; i++) {
+      wave[bits++] = ((uint8_t)*c >> i) & 1;
+    }
+    wave[bits++] = 1;
+  }
+
+  SystemCoreClock = 180000000;
+  SimDwt.CYCCNT = 0;
+  SimGpioD.IDR |= GPIO_IDR_IDR_9;
+  SimRxWave = wave;
+  SimRxWaveStart = 1000;
+  SimRxWaveBaudrate = baudrate;
+  SimRxWaveBits = bits;
+
+  SerialResult_t result = SerialPort3.DetectBaudrate(100000, measured);
+
+  SimRxWaveBits = 0;
+  SystemCoreClock = clock;
+
+  return result;
+}
+
+static void TestDetectBaudrate(void) {
+  uint32_t baudrate;
+
+  CHECK(SerialPort3.Open(&InterruptConfig) == SERIAL_SUCCESS);
+  CHECK(SerialPort3.DetectBaudrate(10, &baudrate) == SERIAL_FAIL);
+  SerialPort3.Close();
+
+  CHECK(SerialPort3.DetectBaudrate(10, NULL) == SERIAL_INVALID_PARAMETER);
+
+  // a line held low never goes idle, nothing to measure
+  SimGpioD.IDR = 0;
+  CHECK(SerialPort3.DetectBaudrate(10, &baudrate) == SERIAL_NO_DATA);
+
+  // PD9 is a plain input with a pull up while measuring
+  CHECK(((SimGpioD.MODER >> 18) & 3) == 0);
+  CHECK(((SimGpioD.PUPDR >> 18) & 3) == 1);
+  CHECK(SimDwt.CTRL & DWT_CTRL_CYCCNTENA_Msk);
+
+  // Open hands the pin back to the USART
+  CHECK(SerialPort3.Open(&InterruptConfig) == SERIAL_SUCCESS);
+  CHECK(((SimGpioD.MODER >> 18) & 3) == 2);
+  SerialPort3.Close();
+
+  // hosts repeat the sync character back to back, the next start bit
+  // falls right after the stop bit and must not be taken for a tenth edge
+  CHECK(SimDetect("UUUU", 115200, &baudrate) == SERIAL_SUCCESS);
+  CHECK(baudrate == 115200);
+  CHECK(SimDetect("\x7F\x7F\x7F", 921600, &baudrate) == SERIAL_SUCCESS);
+  CHECK(baudrate == 921600);
+  CHECK(SimDetect("U", 9600, &baudrate) == SERIAL_SUCCESS);
+  CHECK(baudrate == 9600);
+
+  // an edge before the stop bit ends is still caught
+  CHECK(SimDetect("w", 115200, &baudrate) == SERIAL_FRAMING_ERROR);
+}
+
+static void TestDmaBurstOnIdle(void) {
+  uint8_t burst[5];
+  uint8_t expected = 0;
+
+  for (uint32_t i = 0; i < sizeof(burst); i++) {
+    burst[i] = i;
+  }
+
+  SimDmaReceive(burst, sizeof(burst));
+
+  // nothing is published until the line goes idle
+  CHECK(!SerialPort3.RxBufferHasData());
+
+  SimIdleLine();
+
+  CHECK(SerialPort3.RxBufferHasData());
+  CHECK(Drain(&expected) == sizeof(burst));
+}
+
+static void TestDmaStream(void) {
+  uint8_t chunk[23];
+  uint8_t next = 0;
+  uint8_t expected = 0;
+  uint32_t sent = 0;
+  uint32_t received = 0;
+
+  SerialPort3.Close();
+  CHECK(SerialPort3.Open(&DmaConfig) == SERIAL_SUCCESS);
+
+  // a long burst is published at half transfer before the line goes idle
+  for (uint32_t i = 0; i < RX_SIZE / 2; i++) {
+    chunk[i] = next++;
+  }
+  SimDmaReceive(chunk, RX_SIZE / 2);
+  sent += RX_SIZE / 2;
+  CHECK(SerialPort3.RxBufferHasData());
+  received += Drain(&expected);
+
+  // odd sized bursts wrap the ring at every offset
+  for (uint32_t burst = 0; burst < 200; burst++) {
+    uint32_t length = 1 + burst % sizeof(chunk);
+
+    for (uint32_t i = 0; i < length; i++) {
+      chunk[i] = next++;
+    }
+
+    SimDmaReceive(chunk, length);
+    sent += length;
+    SimIdleLine();
+    received += Drain(&expected);
+  }
+
+  CHECK(received == sent);
+  CHECK(SerialPort3.GetRxDropped() == 0);
+}
+
+static void TestDmaOverrun(void) {
+  uint8_t data[RX_SIZE + 8];
+  uint8_t expected = 8;
+
+  SerialPort3.Close();
+  CHECK(SerialPort3.Open(&DmaConfig) == SERIAL_SUCCESS);
+
+  for (uint32_t i = 0; i < sizeof(data); i++) {
+    data[i] = i;
+  }
+
+  // nobody reads while the DMA laps the ring, the oldest 8 bytes are lost
+  SimDmaReceive(data, sizeof(data));
+  SimIdleLine();
+
+  CHECK(SerialPort3.GetRxDropped() == 8);
+
+  // the loss is reported first, everything after it is intact
+  const uint8_t *peek;
+  CHECK(SerialPort3.PeekBytes(&peek) == SERIAL_BUFFER_FULL);
+  CHECK(Drain(&expected) == RX_SIZE);
+
+  // an overrun in DMA mode arrives through EIE and marks the end of the ring
+  CHECK(SimUsart3.CR3 & USART_CR3_EIE);
+  SimDmaReceive(data, 4);
+  SimUsart3.SR |= USART_SR_ORE;
+  USART3_IRQHandler();
+  SimUsart3.SR &= ~USART_SR_ORE;
+  SimDmaReceive(data + 4, 4);
+  SimIdleLine();
+
+  SerialErrorStats_TypeDef errors;
+  CHECK(SerialPort3.GetErrorStats(&errors) == SERIAL_SUCCESS);
+  CHECK(errors.Overrun == 1);
+
+  uint8_t out[RX_SIZE];
+  CHECK(SerialPort3.GetByte(out, sizeof(out)) == 4);
+  CHECK(SerialPort3.GetByte(out, sizeof(out)) == SERIAL_OVER_RUN);
+  CHECK(SerialPort3.GetByte(out, sizeof(out)) == 4);
+  CHECK(out[0] == 4);
+
+  // one peek can be released in several steps
+  SimDmaReceive(data, 6);
+  SimIdleLine();
+  int32_t peeked = SerialPort3.PeekBytes(&peek);
+  CHECK(peeked > 1 && peek[0] == 0);
+  CHECK(SerialPort3.ConsumeBytes(1) == SERIAL_SUCCESS);
+  CHECK(SerialPort3.ConsumeBytes(peeked - 1) == SERIAL_SUCCESS);
+  expected = peeked;
+  CHECK(Drain(&expected) == 6 - (uint32_t)peeked);
+
+  // the DMA laps the ring between peek and release, the peeked bytes are
+  // gone and the release says so instead of skipping bytes it never saw
+  SimDmaReceive(data, 6);
+  SimIdleLine();
+  peeked = SerialPort3.PeekBytes(&peek);
+  CHECK(peeked > 0 && peek[0] == 0);
+  SimDmaReceive(data + 6, RX_SIZE);
+  SimIdleLine();
+  CHECK(SerialPort3.ConsumeBytes(peeked) == SERIAL_OVER_RUN);
+  CHECK(SerialPort3.GetRxDropped() == 8 + 6);
+  CHECK(SerialPort3.PeekBytes(&peek) == SERIAL_BUFFER_FULL);
+  expected = 6;
+  CHECK(Drain(&expected) == RX_SIZE);
+}
+
+static void TestErrorCounters(void) {
+  uint8_t out[8];
+  SerialErrorStats_TypeDef errors;
+
+  SerialPort3.Close();
+  CHECK(SerialPort3.Open(&InterruptConfig) == SERIAL_SUCCESS);
+  CHECK(SerialPort3.GetErrorStats(NULL) == SERIAL_INVALID_PARAMETER);
+
+  SimUsart3.DR = 'a';
+  SimUsartInterrupt(USART_SR_RXNE, USART_CR1_RXNEIE);
+
+  // junk bytes are counted, not stored
+  SimUsart3.DR = 'f';
+  SimUsartInterrupt(USART_SR_RXNE | USART_SR_FE, USART_CR1_RXNEIE);
+  SimUsart3.DR = 'p';
+  SimUsartInterrupt(USART_SR_RXNE | USART_SR_PE, USART_CR1_RXNEIE);
+  SimUsart3.DR = 'n';
+  SimUsartInterrupt(USART_SR_RXNE | USART_SR_NE, USART_CR1_RXNEIE);
+  CHECK(SerialPort3.GetByte(out, sizeof(out)) == 1);
+  CHECK(out[0] == 'a');
+
+  // the byte in DR on an overrun is kept, the marker goes right after it
+  SimUsart3.DR = 'b';
+  SimUsartInterrupt(USART_SR_RXNE, USART_CR1_RXNEIE);
+  SimUsart3.DR = 'c';
+  SimUsartInterrupt(USART_SR_RXNE | USART_SR_ORE, USART_CR1_RXNEIE);
+  SimUsart3.DR = 'd';
+  SimUsartInterrupt(USART_SR_RXNE, USART_CR1_RXNEIE);
+
+  // a second loss before the reader gets to the first one folds into it
+  SimUsart3.DR = 'e';
+  SimUsartInterrupt(USART_SR_RXNE | USART_SR_ORE, USART_CR1_RXNEIE);
+
+  CHECK(SerialPort3.GetByte(out, sizeof(out)) == 2);
+  CHECK(memcmp(out, "bc", 2) == 0);
+  CHECK(SerialPort3.GetByte(out, sizeof(out)) == SERIAL_OVER_RUN);
+  CHECK(SerialPort3.GetByte(out, sizeof(out)) == 2);
+  CHECK(memcmp(out, "de", 2) == 0);
+  CHECK(SerialPort3.GetByte(out, sizeof(out)) == 0);
+
+  CHECK(SerialPort3.GetErrorStats(&errors) == SERIAL_SUCCESS);
+  CHECK(errors.Overrun == 2);
+  CHECK(errors.Framing == 1);
+  CHECK(errors.Parity == 1);
+  CHECK(errors.Noise == 1);
+  CHECK(errors.LineBreak == 0);
+
+  // a full ring drops the byte and marks where
+  for (uint32_t i = 0; i < RX_SIZE + 1; i++) {
+    SimUsart3.DR = i;
+    SimUsartInterrupt(USART_SR_RXNE, USART_CR1_RXNEIE);
+  }
+
+  uint8_t full[RX_SIZE];
+  CHECK(SerialPort3.GetByte(full, sizeof(full)) == RX_SIZE);
+  CHECK(full[RX_SIZE - 1] == RX_SIZE - 1);
+  CHECK(SerialPort3.GetByte(out, sizeof(out)) == SERIAL_BUFFER_FULL);
+  CHECK(SerialPort3.GetByte(out, sizeof(out)) == 0);
+
+  // counters start over on Open
+  SerialPort3.Close();
+  CHECK(SerialPort3.Open(&InterruptConfig) == SERIAL_SUCCESS);
+  CHECK(SerialPort3.GetErrorStats(&errors) == SERIAL_SUCCESS);
+  CHECK(errors.Overrun == 0 && errors.Framing == 0);
+  SerialPort3.Close();
+}
+
+static void TestInterruptMode(void) {
+  uint8_t data;
+
+  SerialPort3.Close();
+  CHECK(!(SimDma1Stream1.CR & DMA_SxCR_EN));
+  CHECK(!(SimUsart3.CR3 & USART_CR3_DMAR));
+
+  CHECK(SerialPort3.Open(&InterruptConfig) == SERIAL_SUCCESS);
+  CHECK(SimUsart3.CR1 & USART_CR1_RXNEIE);
+  CHECK(!(SimUsart3.CR1 & USART_CR1_IDLEIE));
+
+  SimUsart3.DR = 'x';
+  SimUsartInterrupt(USART_SR_RXNE, USART_CR1_RXNEIE);
+
+  CHECK(SerialPort3.GetByte(&data, 1) == 1);
+  CHECK(data == 'x');
+
+  SerialPort3.Close();
+}
+
+static void TestRtsCts(void) {
+  SerialConfig_TypeDef config = InterruptConfig;
+  uint8_t data[8];
+
+  config.FlowControl = SERIAL_FLOW_RTS_CTS;
+  config.RxHighWatermark = 8;
+  config.RxLowWatermark = 8;
+  CHECK(SerialPort3.Open(&config) == SERIAL_INVALID_PARAMETER);
+
+  config.RxLowWatermark = 4;
+  CHECK(SerialPort3.Open(&config) == SERIAL_SUCCESS);
+  CHECK(SimUsart3.CR3 & USART_CR3_CTSE);
+  CHECK(((SimGpioD.MODER >> 22) & 0x0F) == 0x06); // PD11 CTS on AF, PD12 RTS output
+  CHECK(((SimGpioD.AFR[1] >> 12) & 0x0F) == 7);
+  CHECK(SimGpioD.BSRR == (1U << (12 + 16)));
+
+  for (uint32_t i = 0; i < 8; i++) {
+    SimUsart3.DR = 'a' + i;
+    SimUsartInterrupt(USART_SR_RXNE, USART_CR1_RXNEIE);
+    CHECK(SimGpioD.BSRR == ((i < 7) ? (1U << (12 + 16)) : (1U << 12)));
+  }
+
+  CHECK(SerialPort3.GetByte(data, 3) == 3);
+  CHECK(SimGpioD.BSRR == (1U << 12));
+
+  CHECK(SerialPort3.GetByte(data, 1) == 1);
+  CHECK(data[0] == 'd');
+  CHECK(SimGpioD.BSRR == (1U << (12 + 16)));
+
+  SerialPort3.Close();
+  CHECK(!(SimUsart3.CR3 & USART_CR3_CTSE));
+  CHECK(SimGpioD.BSRR == (1U << 12));
+}
+
+/**
+ * @brief Receive bytes through the RXNE interrupt
+ */
+static void SimUsartReceive(const uint8_t *data, uint32_t length) {
+  for (uint32_t i = 0; i < length; i++) {
+    SimUsart3.DR = data[i];
+    SimUsartInterrupt(USART_SR_RXNE, USART_CR1_RXNEIE);
+  }
+}
+
+static void TestXonXoff(void) {
+  SerialConfig_TypeDef config = TxInterruptConfig;
+  const uint8_t binary[] = { 'a', SERIAL_XON, 'b', SERIAL_ESCAPE };
+  const uint8_t escaped[] = { 'a', SERIAL_ESCAPE, SERIAL_XON ^ 0x20, 'b', SERIAL_ESCAPE, SERIAL_ESCAPE ^ 0x20 };
+  const uint8_t xoff = SERIAL_XOFF;
+  const uint8_t xon = SERIAL_XON;
+  const uint8_t incoming[] = { SERIAL_ESCAPE, SERIAL_XOFF ^ 0x20, 'q' };
+  uint8_t data[8];
+
+  config.FlowControl = SERIAL_FLOW_XON_XOFF_BINARY;
+  config.RxHighWatermark = 8;
+  config.RxLowWatermark = 4;
+
+  config.TxMode = SERIAL_TX_DMA;
+  CHECK(SerialPort3.Open(&config) == SERIAL_INVALID_PARAMETER);
+
+  config.TxMode = SERIAL_TX_INTERRUPT;
+  CHECK(SerialPort3.Open(&config) == SERIAL_SUCCESS);
+  CHECK(!(SimUsart3.CR3 & USART_CR3_CTSE));
+
+  // colliding data bytes go out escaped
+  SimLineLength = 0;
+  CHECK(SerialPort3.SendArray(binary, sizeof(binary)) == SERIAL_SUCCESS);
+  CHECK(SimUsartTransmit() == sizeof(escaped));
+  CHECK(memcmp(SimLine, escaped, sizeof(escaped)) == 0);
+
+  // XOFF holds the queue, XON lets it go, neither is received as data
+  SimLineLength = 0;
+  SimUsartReceive(&xoff, 1);
+  CHECK(SerialPort3.SendString("xy") == SERIAL_SUCCESS);
+  CHECK(SimUsartTransmit() == 0);
+  CHECK(SerialPort3.IsTxBusy());
+
+  SimUsartReceive(&xon, 1);
+  CHECK(SimUsartTransmit() == 2);
+  CHECK(memcmp(SimLine, "xy", 2) == 0);
+  CHECK(!SerialPort3.RxBufferHasData());
+
+  // escaped bytes come in unescaped
+  SimUsartReceive(incoming, sizeof(incoming));
+  CHECK(SerialPort3.GetByte(data, sizeof(data)) == 2);
+  CHECK(data[0] == SERIAL_XOFF && data[1] == 'q');
+
+  // XOFF at the high watermark, XON at the low one, both ahead of data
+  SimLineLength = 0;
+  SimUsartReceive((const uint8_t *)"01234567", 8);
+  CHECK(SerialPort3.SendString("z") == SERIAL_SUCCESS);
+  CHECK(SimUsartTransmit() == 2);
+  CHECK(SimLine[0] == SERIAL_XOFF && SimLine[1] == 'z');
+
+  CHECK(SerialPort3.GetByte(data, 3) == 3);
+  CHECK(SimUsartTransmit() == 0);
+  CHECK(SerialPort3.GetByte(data, 1) == 1);
+  CHECK(SimUsartTransmit() == 1);
+  CHECK(SimLine[2] == SERIAL_XON);
+
+  SerialPort3.Close();
+}
+
+static uint32_t RaisedEvents;
+static uint32_t EventCalls;
+
+static void OnEvent(uint32_t events) {
+  RaisedEvents |= events;
+  EventCalls++;
+}
+
+static void TestRxEvents(void) {
+  SerialEventConfig_TypeDef events = { SERIAL_EVENT_COUNT | SERIAL_EVENT_DELIMITER | SERIAL_EVENT_IDLE, 4, '\r', 100, NULL };
+  uint8_t data[RX_SIZE];
+
+  CHECK(SerialPort3.SetEventCallback(&events) == SERIAL_INVALID_PARAMETER);
+  events.OnEvent = OnEvent;
+  CHECK(SerialPort3.SetEventCallback(&events) == SERIAL_SUCCESS);
+
+  CHECK(SerialPort3.Open(&InterruptConfig) == SERIAL_SUCCESS);
+  CHECK(SimUsart3.CR1 & USART_CR1_IDLEIE);
+
+  // 100 us at 16 MHz
+  SimDwt.CYCCNT = 0;
+  RaisedEvents = 0;
+  SimUsartReceive((const uint8_t *)"abc", 3);
+  CHECK(RaisedEvents == 0);
+
+  SimUsartReceive((const uint8_t *)"d", 1);
+  CHECK(RaisedEvents == SERIAL_EVENT_COUNT);
+
+  // count only fires on the way up
+  RaisedEvents = 0;
+  SimUsartReceive((const uint8_t *)"e\r", 2);
+  CHECK(RaisedEvents == SERIAL_EVENT_DELIMITER);
+
+  // the line idle interrupt is too early, the tick catches the rest
+  RaisedEvents = 0;
+  SimDwt.CYCCNT = 1000;
+  SimIdleLine();
+  SerialPorts_Tick();
+  CHECK(RaisedEvents == 0);
+
+  SimDwt.CYCCNT = 1600;
+  SerialPorts_Tick();
+  CHECK(RaisedEvents == SERIAL_EVENT_IDLE);
+
+  // once per quiet spell
+  EventCalls = 0;
+  SimDwt.CYCCNT = 5000;
+  SerialPorts_Tick();
+  SimIdleLine();
+  CHECK(EventCalls == 0);
+
+  // idle interrupt alone is enough once the time is up
+  SimUsartReceive((const uint8_t *)"f", 1);
+  SimDwt.CYCCNT = 7000;
+  SimIdleLine();
+  CHECK(RaisedEvents == SERIAL_EVENT_IDLE);
+  CHECK(!SimUsart3.SR);
+
+  // idle reads of DR must not land in the ring
+  CHECK(SerialPort3.GetByte(data, sizeof(data)) == 7);
+  CHECK(memcmp(data, "abcde\rf", 7) == 0);
+
+  SerialPort3.Close();
+
+  // DMA mode sees them when the bytes are published
+  RaisedEvents = 0;
+  events.Events = SERIAL_EVENT_COUNT | SERIAL_EVENT_DELIMITER;
+  events.Threshold = 20;
+  CHECK(SerialPort3.SetEventCallback(&events) == SERIAL_SUCCESS);
+  CHECK(SerialPort3.Open(&DmaConfig) == SERIAL_SUCCESS);
+
+  SimDmaReceive((const uint8_t *)"0123456789\r", 11);
+  CHECK(RaisedEvents == 0);
+  SimIdleLine();
+  CHECK(RaisedEvents == SERIAL_EVENT_DELIMITER);
+
+  RaisedEvents = 0;
+  SimDmaReceive((const uint8_t *)"0123456789", 10);
+  SimIdleLine();
+  CHECK(RaisedEvents == SERIAL_EVENT_COUNT);
+
+  CHECK(SerialPort3.SetEventCallback(NULL) == SERIAL_SUCCESS);
+  RaisedEvents = 0;
+  SimDmaReceive((const uint8_t *)"\r", 1);
+  SimIdleLine();
+  CHECK(RaisedEvents == 0);
+
+  SerialPort3.Close();
+}
+
+static void TestScanDelimiter(void) {
+  uint8_t data[64];
+  uint32_t seed = 1;
+
+  // every offset, length and match position against a plain loop
+  for (uint32_t run = 0; run < 2000; run++) {
+    for (uint32_t i = 0; i < sizeof(data); i++) {
+      seed = seed * 1103515245U + 12345U;
+      data[i] = (seed >> 16) & 0x0F;
+    }
+
+    uint32_t offset = run & 3;
+    uint32_t length = (run >> 2) % (sizeof(data) - 3);
+    uint32_t expected = 0;
+
+    while (expected < length && data[offset + expected] != '\r' - 3) {
+      expected++;
+    }
+
+    CHECK(ScanDelimiter(data + offset, length, '\r' - 3) == expected);
+  }
+
+  memset(data, 0x80, sizeof(data));
+  data[37] = 0x00;
+  CHECK(ScanDelimiter(data, sizeof(data), 0x00) == 37);
+  CHECK(ScanDelimiter(data, sizeof(data), 0x01) == sizeof(data));
+  data[36] = 0x01;
+  CHECK(ScanDelimiter(data + 1, sizeof(data) - 1, 0x01) == 35);
+}
+
+static void TestReadLine(void) {
+  uint8_t line[RX_SIZE];
+  uint8_t filler[RX_SIZE];
+
+  memset(filler, 'x', sizeof(filler));
+  CHECK(SerialPort3.Open(&InterruptConfig) == SERIAL_SUCCESS);
+
+  SimUsartReceive((const uint8_t *)"set 1", 5);
+  CHECK(SerialPort3.PeekLine('\r') == 0);
+  CHECK(SerialPort3.ReadUntil('\r', line, sizeof(line)) == 0);
+
+  SimUsartReceive((const uint8_t *)"\rget", 4);
+  CHECK(SerialPort3.PeekLine('\r') == 6);
+  CHECK(SerialPort3.ReadUntil('\r', line, sizeof(line)) == 6);
+  CHECK(memcmp(line, "set 1\r", 6) == 0);
+  CHECK(SerialPort3.PeekLine('\r') == 0);
+
+  // a line across the end of the ring
+  SimUsartReceive(filler, 25);
+  SimUsartReceive((const uint8_t *)"\r", 1);
+  CHECK(SerialPort3.PeekLine('\r') == 29);
+  CHECK(SerialPort3.ReadUntil('\r', line, sizeof(line)) == 29);
+  CHECK(memcmp(line, "get", 3) == 0 && line[28] == '\r');
+
+  // too long for destination, handed over in pieces
+  SimUsartReceive((const uint8_t *)"0123456789\r", 11);
+  CHECK(SerialPort3.ReadUntil('\r', line, 4) == 4);
+  CHECK(memcmp(line, "0123", 4) == 0);
+  CHECK(SerialPort3.ReadUntil('\r', line, sizeof(line)) == 7);
+
+  // a full ring without a delimiter is all one line
+  SimUsartReceive(filler, RX_SIZE);
+  CHECK(SerialPort3.PeekLine('\r') == RX_SIZE);
+  CHECK(SerialPort3.ReadUntil('\r', line, sizeof(line)) == RX_SIZE);
+
+  // a loss cuts the line short, then is reported
+  SimUsartReceive((const uint8_t *)"ab", 2);
+  SimUsart3.DR = 'c';
+  SimUsartInterrupt(USART_SR_RXNE | USART_SR_ORE, USART_CR1_RXNEIE);
+  SimUsartReceive((const uint8_t *)"d\r", 2);
+  CHECK(SerialPort3.PeekLine('\r') == 3);
+  CHECK(SerialPort3.ReadUntil('\r', line, sizeof(line)) == 3);
+  CHECK(SerialPort3.ReadUntil('\r', line, sizeof(line)) == SERIAL_OVER_RUN);
+  CHECK(SerialPort3.ReadUntil('\r', line, sizeof(line)) == 2);
+  CHECK(line[0] == 'd');
+
+  SerialPort3.Close();
+  CHECK(SerialPort3.ReadUntil('\r', line, sizeof(line)) == SERIAL_CLOSED);
+}
+
+/**
+ * @brief A byte lands in DR while the driver polls, it takes it or it is overwritten
+ */
+static void SimUsartPoll(uint8_t data, uint32_t sr) {
+  SimUsart3.DR = data;
+  SimUsart3.SR |= USART_SR_RXNE | sr;
+  SerialPort3.PollRx();
+  SimUsart3.SR &= ~(USART_SR_RXNE | sr);
+}
+
+static void TestHybridRx(void) {
+  SerialConfig_TypeDef config = InterruptConfig;
+  uint8_t data[RX_SIZE];
+  uint8_t next = 0;
+
+  config.RxMode = SERIAL_RX_HYBRID;
+  CHECK(SerialPort3.Open(&config) == SERIAL_SUCCESS);
+  CHECK(SimUsart3.CR1 & USART_CR1_RXNEIE);
+
+  // a reader that sleeps between reads never called PollRx, a burst stays
+  // on interrupts and nothing is lost while it sleeps
+  for (uint32_t i = 0; i < USART_RX_HYBRID_BURST * 3 / 4; i++) {
+    SimUsartReceive(&next, 1);
+    next++;
+  }
+  CHECK(SerialPort3.GetByte(data, sizeof(data)) == USART_RX_HYBRID_BURST * 3 / 4);
+
+  for (uint32_t i = 0; i < USART_RX_HYBRID_BURST * 3 / 4; i++) {
+    SimUsartReceive(&next, 1);
+    next++;
+  }
+  CHECK(SimUsart3.CR1 & USART_CR1_RXNEIE);
+  CHECK(SerialPort3.GetByte(data, sizeof(data)) == USART_RX_HYBRID_BURST * 3 / 4);
+  CHECK(data[0] == USART_RX_HYBRID_BURST * 3 / 4);
+  CHECK(data[USART_RX_HYBRID_BURST * 3 / 4 - 1] == USART_RX_HYBRID_BURST * 3 / 2 - 1);
+  CHECK(SerialPort3.GetRxDropped() == 0);
+  next = 0;
+
+  // quiet traffic stays on interrupts
+  SerialPorts_Tick();
+  CHECK(SerialPort3.PollRx() == 0);
+
+  for (uint32_t i = 0; i < USART_RX_HYBRID_BURST - 1; i++) {
+    SimUsartReceive(&next, 1);
+    next++;
+  }
+  CHECK(SimUsart3.CR1 & USART_CR1_RXNEIE);
+  CHECK(SerialPort3.GetByte(data, sizeof(data)) == USART_RX_HYBRID_BURST - 1);
+
+  // the burst switches to polling
+  SimUsartReceive(&next, 1);
+  next++;
+  CHECK(!(SimUsart3.CR1 & USART_CR1_RXNEIE));
+
+  // with RXNEIE off only the readers take bytes
+  SimUsartInterrupt(USART_SR_RXNE, USART_CR1_RXNEIE);
+  for (uint32_t i = 0; i < 8; i++) {
+    SimUsartPoll(next++, 0);
+  }
+  CHECK(SerialPort3.GetByte(data, sizeof(data)) == 9);
+  CHECK(data[0] == USART_RX_HYBRID_BURST - 1 && data[8] == USART_RX_HYBRID_BURST + 7);
+
+  // busy tick stays polling, a quiet one goes back through the ISR
+  SerialPorts_Tick();
+  CHECK(!(SimUsart3.CR1 & USART_CR1_RXNEIE));
+  SimUsartPoll(next++, 0);
+  SerialPorts_Tick();
+  CHECK(SimUsart3.CR1 & USART_CR1_RXNEIE);
+  CHECK(SerialPort3.PollRx() == 0);
+  CHECK(SerialPort3.GetByte(data, sizeof(data)) == 1);
+
+  // an overrun while polling goes back right away
+  for (uint32_t i = 0; i < USART_RX_HYBRID_BURST; i++) {
+    SimUsartReceive(&next, 1);
+  }
+  CHECK(!(SimUsart3.CR1 & USART_CR1_RXNEIE));
+  CHECK(SerialPort3.GetByte(data, sizeof(data)) == USART_RX_HYBRID_BURST);
+
+  SimUsartPoll('o', USART_SR_ORE);
+  CHECK(SimUsart3.CR1 & USART_CR1_RXNEIE);
+  CHECK(SerialPort3.GetByte(data, sizeof(data)) == 1);
+  CHECK(data[0] == 'o');
+  CHECK(SerialPort3.GetByte(data, sizeof(data)) == SERIAL_OVER_RUN);
+
+  // still busy but the application stopped calling PollRx, the next tick
+  // goes back to interrupts before it can go to sleep on a full DR
+  SerialPorts_Tick();
+  CHECK(SerialPort3.PollRx() == 0);
+  for (uint32_t i = 0; i < USART_RX_HYBRID_BURST; i++) {
+    SimUsartReceive(&next, 1);
+  }
+  CHECK(!(SimUsart3.CR1 & USART_CR1_RXNEIE));
+  CHECK(SerialPort3.GetByte(data, sizeof(data)) == USART_RX_HYBRID_BURST);
+
+  SerialPorts_Tick();
+  for (uint32_t i = 0; i < USART_RX_HYBRID_QUIET; i++) {
+    SimUsart3.DR = next;
+    SimUsart3.SR |= USART_SR_RXNE;
+    CHECK(SerialPort3.RxBufferHasData());
+    SimUsart3.SR &= ~USART_SR_RXNE;
+  }
+  CHECK(!(SimUsart3.CR1 & USART_CR1_RXNEIE));
+  SerialPorts_Tick();
+  CHECK(SimUsart3.CR1 & USART_CR1_RXNEIE);
+  CHECK(SerialPort3.GetByte(data, sizeof(data)) == USART_RX_HYBRID_QUIET);
+
+  SerialPort3.Close();
+}
+
+static void TestRxBroadcast(void) {
+  static uint8_t broadcastBuffer[32];
+  static FIFOBroadcastContext_TypeDef broadcast;
+  FIFOBroadcastReader_TypeDef echo, logger;
+  uint8_t data[RX_SIZE];
+  uint8_t burst[20];
+
+  CHECK(FIFO_Broadcast_Init(&broadcast, sizeof(broadcastBuffer), broadcastBuffer) == 0);
+  SerialPort3.SetRxBroadcast(&broadcast);
+  FIFO_Broadcast_ReaderInit(&echo, &broadcast);
+  FIFO_Broadcast_ReaderInit(&logger, &broadcast);
+
+  // interrupt mode, every byte goes to the RX ring and to both readers
+  CHECK(SerialPort3.Open(&InterruptConfig) == SERIAL_SUCCESS);
+  SimUsartReceive((const uint8_t *)"hello", 5);
+  CHECK(FIFO_Broadcast_ReadN(&echo, data, sizeof(data)) == 5);
+  CHECK(memcmp(data, "hello", 5) == 0);
+  CHECK(FIFO_Broadcast_ReadN(&logger, data, sizeof(data)) == 5);
+  CHECK(memcmp(data, "hello", 5) == 0);
+  CHECK(SerialPort3.GetByte(data, sizeof(data)) == 5);
+  CHECK(memcmp(data, "hello", 5) == 0);
+
+  // the logger falls behind and is skipped ahead, the echo and GetByte aren't
+  for (uint32_t round = 0; round < 2; round++) {
+    for (uint32_t i = 0; i < sizeof(burst); i++) {
+      burst[i] = round * sizeof(burst) + i;
+    }
+    SimUsartReceive(burst, sizeof(burst));
+    CHECK(FIFO_Broadcast_ReadN(&echo, data, sizeof(data)) == sizeof(burst));
+    CHECK(data[0] == burst[0]);
+    CHECK(SerialPort3.GetByte(data, sizeof(data)) == sizeof(burst));
+  }
+
+  CHECK(FIFO_Broadcast_Lag(&logger) == 2 * sizeof(burst));
+  CHECK(FIFO_Broadcast_ReadN(&logger, data, sizeof(data)) == sizeof(broadcastBuffer));
+  CHECK(data[0] == 2 * sizeof(burst) - sizeof(broadcastBuffer));
+  CHECK(FIFO_Broadcast_CheckOverrun(&logger));
+  CHECK(logger.Lost == 2 * sizeof(burst) - sizeof(broadcastBuffer));
+  CHECK(!FIFO_Broadcast_CheckOverrun(&echo));
+  SerialPort3.Close();
+
+  // DMA mode, bursts wrap the RX ring and still reach the readers in order
+  CHECK(SerialPort3.Open(&DmaConfig) == SERIAL_SUCCESS);
+  for (uint32_t round = 0; round < 5; round++) {
+    for (uint32_t i = 0; i < sizeof(burst); i++) {
+      burst[i] = round * sizeof(burst) + i;
+    }
+    SimDmaReceive(burst, sizeof(burst));
+    SimIdleLine();
+
+    CHECK(FIFO_Broadcast_ReadN(&echo, data, sizeof(data)) == sizeof(burst));
+    CHECK(memcmp(data, burst, sizeof(burst)) == 0);
+    CHECK(FIFO_Broadcast_ReadN(&logger, data, sizeof(data)) == sizeof(burst));
+    CHECK(memcmp(data, burst, sizeof(burst)) == 0);
+    CHECK(SerialPort3.GetByte(data, sizeof(data)) == sizeof(burst));
+  }
+  CHECK(!FIFO_Broadcast_CheckOverrun(&logger));
+
+  // detached, only the RX ring gets bytes
+  SerialPort3.SetRxBroadcast(NULL);
+  SimDmaReceive(burst, 3);
+  SimIdleLine();
+  CHECK(FIFO_Broadcast_ReadN(&echo, data, sizeof(data)) == 0);
+  CHECK(SerialPort3.GetByte(data, sizeof(data)) == 3);
+
+  SerialPort3.Close();
+}
+
+static void TestDmaTransmit(void) {
+  const uint8_t more[] = "0123456789";
+
+  SimLineLength = 0;
+  TxCallbacks = 0;
+
+  CHECK(SerialPort3.Open(&TxDmaConfig) == SERIAL_SUCCESS);
+  SerialPort3.SetTxCallback(OnTxComplete);
+
+  CHECK(SimUsart3.CR3 & USART_CR3_DMAT);
+  CHECK(SimDma1Stream3.PAR == (uint32_t)(uintptr_t)&SimUsart3.DR);
+  CHECK((SimDma1Stream3.CR & DMA_SxCR_CHSEL) == DMA_SxCR_CHSEL_2);
+  CHECK((SimDma1Stream3.CR & DMA_SxCR_DIR) == DMA_SxCR_DIR_0);
+  CHECK(SimDma1Stream3.CR & DMA_SxCR_MINC);
+  CHECK(SimDma1Stream3.CR & DMA_SxCR_TCIE);
+  CHECK(SimDma1Stream3.CR & DMA_SxCR_TEIE);
+  CHECK(!SerialPort3.IsTxBusy());
+
+  // returns as soon as the bytes are queued, the DMA is already running
+  CHECK(SerialPort3.SendString("hello") == SERIAL_SUCCESS);
+  CHECK(SimDma1Stream3.CR & DMA_SxCR_EN);
+  CHECK(SimDma1Stream3.NDTR == 5);
+  CHECK(SerialPort3.IsTxBusy());
+
+  // queued behind the running transfer, it doesn't restart the stream
+  CHECK(SerialPort3.SendArray(more, sizeof(more) - 1) == SERIAL_SUCCESS);
+  CHECK(SimDma1Stream3.NDTR == 5);
+
+  CHECK(SimDmaTransmit() == 5);
+  CHECK(SimDmaTransmit() == sizeof(more) - 1);
+  CHECK(SimDmaTransmit() == 0);
+  CHECK(SimLineLength == 15);
+  CHECK(memcmp(SimLine, "hello0123456789", 15) == 0);
+
+  // ring is drained but the last byte is still shifting out
+  CHECK(TxCallbacks == 0);
+  CHECK(SerialPort3.IsTxBusy());
+
+  SimUsartInterrupt(USART_SR_TC, USART_CR1_TCIE);
+
+  CHECK(TxCallbacks == 1);
+  CHECK(!SerialPort3.IsTxBusy());
+
+  // a transfer error stops the stream with no TC, its bytes are dropped and
+  // TX goes on with what was queued behind them
+  CHECK(SerialPort3.SendString("lost") == SERIAL_SUCCESS);
+  CHECK(SerialPort3.SendString("next") == SERIAL_SUCCESS);
+  CHECK(SimDma1Stream3.NDTR == 4);
+
+  SimDma1Stream3.CR &= ~DMA_SxCR_EN;
+  SimDma1.LISR |= DMA_LISR_TEIF3;
+  DMA1_Stream3_IRQHandler();
+  SimDma1.LISR &= ~SimDma1.LIFCR;
+  SimDma1.LIFCR = 0;
+
+  CHECK(!(SimDma1.LISR & DMA_LISR_TEIF3));
+  CHECK(Usart_GetLastError(&SerialPort3_Context) == SERIAL_DMA_ERROR);
+  CHECK(SimDma1Stream3.CR & DMA_SxCR_EN);
+  CHECK(SimDmaTransmit() == 4);
+  CHECK(memcmp(SimLine + 15, "next", 4) == 0);
+  CHECK(SimDmaTransmit() == 0);
+  CHECK(SerialPort3.SendString("more") == SERIAL_SUCCESS);
+  CHECK(SimDmaTransmit() == 4);
+
+  SerialPort3.Close();
+}
+
+static void TestDmaTransmitWrap(void) {
+  uint8_t chunk[50];
+  uint8_t next = 0;
+
+  SimLineLength = 0;
+
+  CHECK(SerialPort3.Open(&TxDmaConfig) == SERIAL_SUCCESS);
+
+  // 50 byte sends walk the 128 byte ring, transfers split at its end
+  for (uint32_t send = 0; send < 40; send++) {
+    for (uint32_t i = 0; i < sizeof(chunk); i++) {
+      chunk[i] = next++;
+    }
+
+    CHECK(SerialPort3.SendArray(chunk, sizeof(chunk)) == SERIAL_SUCCESS);
+
+    if (send & 1) {
+      while (SimDmaTransmit());
+    }
+  }
+
+  while (SimDmaTransmit());
+
+  CHECK(SimLineLength == 40 * sizeof(chunk));
+  for (uint32_t i = 0; i < SimLineLength; i++) {
+    if (SimLine[i] != (uint8_t)i) {
+      CHECK(SimLine[i] == (uint8_t)i);
+      break;
+    }
+  }
+
+  SerialPort3.Close();
+}
+
+static void TestInterruptTransmit(void) {
+  uint8_t chunk[50];
+  uint8_t next = 0;
+
+  SimLineLength = 0;
+  TxCallbacks = 0;
+
+  CHECK(SerialPort3.Open(&TxInterruptConfig) == SERIAL_SUCCESS);
+  SerialPort3.SetTxCallback(OnTxComplete);
+
+  // DR is still busy, the bytes wait in the ring with TXE enabled
+  CHECK(SerialPort3.SendString("hello") == SERIAL_SUCCESS);
+  CHECK(SimLineLength == 0);
+  CHECK(SimUsart3.CR1 & USART_CR1_TXEIE);
+  CHECK(SerialPort3.IsTxBusy());
+
+  CHECK(SimUsartTransmit() == 5);
+  CHECK(memcmp(SimLine, "hello", 5) == 0);
+  CHECK(!(SimUsart3.CR1 & (USART_CR1_TXEIE | USART_CR1_TCIE)));
+  CHECK(TxCallbacks == 1);
+  CHECK(!SerialPort3.IsTxBusy());
+
+  // receiving while TX is idle must not look like an end of transmission
+  SimUsart3.DR = 'x';
+  SimUsartInterrupt(USART_SR_RXNE | USART_SR_TXE | USART_SR_TC, USART_CR1_RXNEIE);
+  CHECK(TxCallbacks == 1);
+
+  SimLineLength = 0;
+
+  for (uint32_t send = 0; send < 40; send++) {
+    for (uint32_t i = 0; i < sizeof(chunk); i++) {
+      chunk[i] = next++;
+    }
+
+    CHECK(SerialPort3.SendArray(chunk, sizeof(chunk)) == SERIAL_SUCCESS);
+
+    if (send & 1) {
+      SimUsartTransmit();
+    }
+  }
+
+  CHECK(SimLineLength == 40 * sizeof(chunk));
+  for (uint32_t i = 0; i < SimLineLength; i++) {
+    if (SimLine[i] != (uint8_t)i) {
+      CHECK(SimLine[i] == (uint8_t)i);
+      break;
+    }
+  }
+
+  SerialPort3.Close();
+}
+
+/**
+ * @brief Sending from an interrupt handler with the TX ring full doesn't wait
+ */
+static void TestHandlerTransmit(void) {
+  uint8_t data[TX_SIZE + 72];
+
+  for (uint32_t i = 0; i < sizeof(data); i++) {
+    data[i] = (uint8_t)i;
+  }
+
+  for (uint32_t round = 0; round < 2; round++) {
+    SimLineLength = 0;
+
+    CHECK(SerialPort3.Open(round ? &TxInterruptConfig : &TxDmaConfig) == SERIAL_SUCCESS);
+
+    // SysTick, the TX ISRs can't run before this returns
+    SimIpsr = SysTick_IRQn + 16;
+    CHECK(SerialPort3.SendArray(data, sizeof(data)) == SERIAL_BUFFER_FULL);
+    CHECK(SerialPort3.SendByte('x') == SERIAL_BUFFER_FULL);
+    CHECK(SerialPort3.SendString("x") == SERIAL_BUFFER_FULL);
+    SimIpsr = 0;
+
+    // what fitted goes out, nothing else
+    if (round) {
+      SimUsartTransmit();
+    }
+    else {
+      while (SimDmaTransmit());
+    }
+
+    CHECK(SimLineLength == TX_SIZE);
+    CHECK(memcmp(SimLine, data, TX_SIZE) == 0);
+
+    // with room again a handler queues like anyone else
+    SimIpsr = USART3_IRQn + 16;
+    CHECK(SerialPort3.SendString("ok") == SERIAL_SUCCESS);
+    SimIpsr = 0;
+
+    if (round) {
+      SimUsartTransmit();
+    }
+    else {
+      while (SimDmaTransmit());
+    }
+
+    CHECK(SimLineLength == TX_SIZE + 2);
+    CHECK(memcmp(SimLine + TX_SIZE, "ok", 2) == 0);
+
+    SerialPort3.Close();
+  }
+}
+
+static void TestSecondPort(void) {
+  CHECK(SerialPort3.Open(&TxDmaConfig) == SERIAL_SUCCESS);
+  CHECK(SerialPort6.Open(&Port6Config) == SERIAL_SUCCESS);
+
+  CHECK(SimRcc.APB2ENR & RCC_APB2ENR_USART6EN);
+  CHECK(SimRcc.AHB1ENR & RCC_AHB1ENR_DMA2EN);
+  CHECK(SimNvicEnabled[USART6_IRQn]);
+  CHECK(SimNvicEnabled[DMA2_Stream6_IRQn]);
+
+  // PC6/PC7 in alternate function mode on AF8
+  CHECK(((SimGpioC.MODER >> 12) & 0x0F) == 0x0A);
+  CHECK(((SimGpioC.AFR[0] >> 24) & 0xFF) == 0x88);
+
+  CHECK(SimDma2Stream1.M0AR == (uint32_t)(uintptr_t)rxStorage6);
+  CHECK(SimDma2Stream1.NDTR == PORT6_RX_SIZE);
+  CHECK(SimDma2Stream6.PAR == (uint32_t)(uintptr_t)&SimUsart6.DR);
+  CHECK((SimDma2Stream6.CR & DMA_SxCR_CHSEL) == (DMA_SxCR_CHSEL_2 | DMA_SxCR_CHSEL_0));
+
+  // each port queues into its own ring and starts its own stream
+  CHECK(SerialPort6.SendString("six") == SERIAL_SUCCESS);
+  CHECK(SimDma2Stream6.CR & DMA_SxCR_EN);
+  CHECK(SimDma2Stream6.NDTR == 3);
+  CHECK(SimDma2Stream6.M0AR == (uint32_t)(uintptr_t)txStorage6);
+  CHECK(!(SimDma1Stream3.CR & DMA_SxCR_EN));
+  CHECK(!SerialPort3.IsTxBusy());
+
+  // stream 6 reports in the high flag registers
+  SimDma2Stream6.CR &= ~DMA_SxCR_EN;
+  SimDma2.LIFCR = 0;
+  SimDma2.HISR |= DMA_HISR_TCIF6;
+  DMA2_Stream6_IRQHandler();
+  CHECK(SimDma2.HIFCR & DMA_HIFCR_CTCIF6);
+  CHECK(SimDma2.LIFCR == 0);
+  CHECK(SimUsart6.CR1 & USART_CR1_TCIE);
+
+  SerialPort3.Close();
+  SerialPort6.Close();
+  CHECK(!SimNvicEnabled[USART6_IRQn]);
+}
+
+static int Run(const char *name, void (*test)(void)) {
+  uint32_t before = Failures;
+
+  test();
+
+  printf("%s %s\n", (Failures == before) ? "PASS" : "FAIL", name);
+  return Failures != before;
+}
+
+int main(void) {
+  int failed = 0;
+
+  failed |= Run("baud plan", TestBaudPlan);
+  failed |= Run("open baud", TestOpenBaud);
+  failed |= Run("baud from edges", TestBaudFromEdges);
+  failed |= Run("detect baudrate", TestDetectBaudrate);
+  failed |= Run("open storage", TestOpenStorage);
+  failed |= Run("dma open", TestDmaOpen);
+  failed |= Run("dma burst on idle", TestDmaBurstOnIdle);
+  failed |= Run("dma stream", TestDmaStream);
+  failed |= Run("dma overrun", TestDmaOverrun);
+  failed |= Run("error counters", TestErrorCounters);
+  failed |= Run("interrupt mode", TestInterruptMode);
+  failed |= Run("rts cts", TestRtsCts);
+  failed |= Run("xon xoff", TestXonXoff);
+  failed |= Run("rx events", TestRxEvents);
+  failed |= Run("scan delimiter", TestScanDelimiter);
+  failed |= Run("read line", TestReadLine);
+  failed |= Run("hybrid rx", TestHybridRx);
+  failed |= Run("rx broadcast", TestRxBroadcast);
+  failed |= Run("dma transmit", TestDmaTransmit);
+  failed |= Run("dma transmit wrap", TestDmaTransmitWrap);
+  failed |= Run("interrupt transmit", TestInterruptTransmit);
+  failed |= Run("handler transmit", TestHandlerTransmit);
+  failed |= Run("second port", TestSecondPort);
+
+  return failed;
+}
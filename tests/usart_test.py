@@ -28,10 +28,22 @@ def frame_error():
 
     print "Done"
 
+def auto_baud():
+    print "auto baud test started, reset the board first"
+    port = serial.Serial(args.device, baudrate=args.baudrate, timeout=3)
+
+    # sync character, measured by the device and not echoed
+    port.write("\x55")
+    port.read(1000) # header
+
+    port.write("ping")
+    print "echo: " + port.read(4)
+
 parser = argparse.ArgumentParser(description='USART tester')
 
 parser.add_argument('-over_run', action='store_true', default=False)
 parser.add_argument('-frame_error', action='store_true', default=False)
+parser.add_argument('-auto_baud', action='store_true', default=False)
 parser.add_argument('baudrate', type=int)
 parser.add_argument('device', type=str)
 
@@ -41,5 +53,7 @@ if args.over_run:
     over_run()
 elif args.frame_error:
     frame_error()
+elif args.auto_baud:
+    auto_baud()
 else:
     parser.print_help()